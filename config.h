@@ -101,9 +101,13 @@
 #define UTIL_WEIGHT .61
 
 /*
- * Alignment requirement in bytes (either 4 or 8)
+ * Alignment requirement in bytes (8, or 16 with -DMM_ALIGN16, as mm.h)
  */
+#ifdef MM_ALIGN16
+#define ALIGNMENT 16
+#else
 #define ALIGNMENT 8
+#endif
 
 /*
  * Maximum heap size in bytes
@@ -0,0 +1,25 @@
+/*
+ * ctrace.h - a trace compiled to C by trace2c
+ *
+ * trace2c turns a .rep file into straight-line calls to mm_malloc,
+ * mm_free and mm_realloc on a static array of block pointers, split
+ * into functions of a bounded number of ops. Linked into the driver
+ * ("make mdriver-ctrace TRACE=<file>"), it replays the trace without
+ * the interpreter's per-op switch and index loads (mdriver -C).
+ */
+#ifndef __CTRACE_H_
+#define __CTRACE_H_
+
+typedef struct {
+    const char *name;           /* trace file it was compiled from */
+    int num_ops;
+    int nfuncs;
+    void (*const *funcs)(void); /* called in order, replay the trace */
+    void (*reset)(void);        /* clears the block pointers; called
+                                   before each replay */
+} ctrace_t;
+
+/* Defined only if a trace2c output is linked in */
+extern const ctrace_t mm_ctrace __attribute__((weak));
+
+#endif /* __CTRACE_H_ */
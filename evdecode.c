@@ -0,0 +1,172 @@
+/*
+ * evdecode.c - decode an allocator event dump written by mm_event_dump()
+ *
+ * usage: evdecode [-s] <dumpfile>
+ *     -s   print only the summary, not every record
+ *
+ * Addresses are printed as offsets from the lowest address seen in the
+ * dump, and times as cycles since the first record of each ring. The
+ * summary only counts the records still in the rings; it says how many
+ * were dropped, which MM_EVENT_RING avoids when set large enough.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mmevent.h"
+
+static const char *ev_names[EV_NTYPES] = {
+    "?", "malloc", "free", "realloc", "split", "coalesce",
+    "extend", "insert", "delete", "search"
+};
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: evdecode [-s] <dumpfile>\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    FILE *fp;
+    mm_evfile_t fh;
+    mm_evring_t rh;
+    mm_event_t e;
+    uint32_t ring, i;
+    uint64_t base = 0, tsc0 = 0;
+    long pos;
+    int c, summary_only = 0;
+
+    /* summary counters */
+    unsigned long count[EV_NTYPES] = {0};
+    unsigned long coalesce_case[5] = {0};
+    unsigned long probes = 0, max_probes = 0, misses = 0;
+    unsigned long extend_bytes = 0, split_remainder = 0;
+    unsigned long color_splits = 0, color_bytes = 0;
+    unsigned long unmap_bytes = 0, dropped = 0;
+
+    while ((c = getopt(argc, argv, "sh")) != EOF) {
+        switch (c) {
+        case 's':
+            summary_only = 1;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc - 1)
+        usage();
+
+    if ((fp = fopen(argv[optind], "rb")) == NULL) {
+        perror(argv[optind]);
+        exit(1);
+    }
+    if (fread(&fh, sizeof(fh), 1, fp) != 1 || fh.magic != EV_MAGIC) {
+        fprintf(stderr, "%s: not an event dump\n", argv[optind]);
+        exit(1);
+    }
+    if (fh.version != EV_VERSION || fh.record_size != sizeof(mm_event_t)) {
+        fprintf(stderr, "%s: unsupported version %u (record size %u)\n",
+                argv[optind], fh.version, fh.record_size);
+        exit(1);
+    }
+
+    /* First pass: find the lowest address so offsets are readable */
+    pos = ftell(fp);
+    for (ring = 0; ring < fh.nrings; ring++) {
+        if (fread(&rh, sizeof(rh), 1, fp) != 1)
+            break;
+        for (i = 0; i < rh.nrecords; i++) {
+            if (fread(&e, sizeof(e), 1, fp) != 1)
+                break;
+            if (e.addr != 0 && (base == 0 || e.addr < base))
+                base = e.addr;
+        }
+    }
+    fseek(fp, pos, SEEK_SET);
+
+    for (ring = 0; ring < fh.nrings; ring++) {
+        if (fread(&rh, sizeof(rh), 1, fp) != 1) {
+            fprintf(stderr, "truncated dump (ring %u)\n", ring);
+            exit(1);
+        }
+        dropped += rh.dropped;
+        if (!summary_only || rh.dropped)
+            printf("# thread %u: %u records, %lu dropped\n",
+                   rh.tid, rh.nrecords, (unsigned long)rh.dropped);
+        for (i = 0; i < rh.nrecords; i++) {
+            if (fread(&e, sizeof(e), 1, fp) != 1) {
+                fprintf(stderr, "truncated dump (ring %u, record %u)\n",
+                        ring, i);
+                exit(1);
+            }
+            if (i == 0)
+                tsc0 = e.tsc;
+            if (e.type >= EV_NTYPES)
+                e.type = 0;
+
+            count[e.type]++;
+            switch (e.type) {
+            case EV_COALESCE:
+                if (e.sub >= 1 && e.sub <= 4)
+                    coalesce_case[e.sub]++;
+                break;
+            case EV_SEARCH:
+                probes += e.aux;
+                if (e.addr == 0)
+                    misses++;
+                if (e.aux > max_probes)
+                    max_probes = e.aux;
+                break;
+            case EV_EXTEND:
+                if (e.sub == 2)
+                    unmap_bytes += e.size;
+                else
+                    extend_bytes += e.size;
+                break;
+            case EV_SPLIT:
+                if (e.sub == 1) {
+                    color_splits++;
+                    color_bytes += e.size;
+                } else {
+                    split_remainder += e.aux;
+                }
+                break;
+            }
+
+            if (summary_only)
+                continue;
+            printf("%10u %12lu %-8s %3u %#10lx %8u %8u\n",
+                   e.seq, (unsigned long)(e.tsc - tsc0), ev_names[e.type],
+                   e.sub, e.addr ? (unsigned long)(e.addr - base) : 0UL,
+                   e.size, e.aux);
+        }
+    }
+    fclose(fp);
+
+    printf("\nSummary:\n");
+    if (dropped)
+        printf("  dropped  %10lu (counts below cover only the last records "
+               "of each thread;\n"
+               "           rerun with MM_EVENT_RING set to a larger ring)\n",
+               dropped);
+    for (i = 1; i < EV_NTYPES; i++)
+        printf("  %-8s %10lu\n", ev_names[i], count[i]);
+    printf("  coalesce cases: 1=%lu 2=%lu 3=%lu 4=%lu\n",
+           coalesce_case[1], coalesce_case[2],
+           coalesce_case[3], coalesce_case[4]);
+    if (count[EV_SEARCH])
+        printf("  search: %.2f probes/search (max %lu), "
+               "%lu found no fit\n",
+               (double)probes / count[EV_SEARCH], max_probes, misses);
+    if (count[EV_SPLIT] > color_splits)
+        printf("  split: %.1f bytes remainder on average\n",
+               (double)split_remainder / (count[EV_SPLIT] - color_splits));
+    if (color_splits)
+        printf("  coloring: %lu leading splits, %lu bytes\n",
+               color_splits, color_bytes);
+    printf("  extend: %lu bytes total, %lu unmapped with segments\n",
+           extend_bytes, unmap_bytes);
+    return 0;
+}
@@ -18,12 +18,21 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/personality.h>
+#include <sys/resource.h>
 
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "clock.h"
 #include "config.h"
+#include "mmevent.h"
+#include "mmphase.h"
+#include "mmbench.h"
+#include "ctrace.h"
+#include "mmcachesim.h"
+#include "mmsuite.h"
 
 /**********************
  * Constants and macros
@@ -82,6 +91,10 @@ typedef struct {
     int *block_rand_base;/* index into random_data, if debug is on */
 } trace_t;
 
+/* Called by replay_trace around the ops of a trace (see there) */
+typedef void (*replay_hook_t)(trace_t *trace, int opnum, char *p,
+                              uint64_t cycles, void *ctx);
+
 /*
  * Holds the params to the xxx_speed functions, which are timed by fcyc.
  * This struct is necessary because fcyc accepts only a pointer array
@@ -105,6 +118,13 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    int paged;       /* were the faults of a cold run measured (-F)? */
+    double minflt;   /* minor and major page faults of that run */
+    double majflt;
+    double pages;    /* heap pages it touched */
+    double moves;    /* reallocs that moved their block, */
+    double move_bytes; /* the payload bytes they copied */
+    double move_secs;  /* and the time they took */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
@@ -144,6 +164,34 @@ int onetime_flag = 0;
 /* by default, no timeouts */
 static int set_timeout = 0;
 
+/* If set, dump the allocator's event trace of each correctness run here */
+static char *event_file = NULL;
+
+/* If set, print where the allocator spends its cycles for each trace */
+static int phase_flag = 0;
+
+/* If set, run this payload-touching benchmark instead of the traces */
+static char *bench_name = NULL;
+
+/* If set, time the trace compiled in with trace2c instead of the traces */
+static int ctrace_flag = 0;
+
+/* If set, print simulated cache and TLB misses for each trace */
+static int cachesim_flag = 0;
+static mm_cachesim_counts_t cachesim_total[CS_NKINDS];
+static long cachesim_ops = 0;
+
+/* If set, count the page faults and pages touched of each trace */
+static int fault_flag = 0;
+
+/* If set, time the reallocs of each trace that move their block */
+static int moves_flag = 0;
+
+/* If set, score the build on this suite manifest (see mmsuite.h) */
+static mm_suite_t *suite = NULL;
+static mm_suite_trace_t *suite_traces = NULL;
+static char *suite_label = NULL;
+
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
@@ -185,12 +233,24 @@ static void eval_libc_speed(void *ptr);
 
 /* Routines for evaluating correctnes, space utilization, and speed
    of the student's malloc package in mm.c */
+static void replay_trace(trace_t *trace, replay_hook_t hook, void *ctx);
 static int eval_mm_valid(trace_t *trace, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_latency(trace_t *trace, mm_suite_trace_t *st);
+static void eval_mm_faults(trace_t *trace, stats_t *stats);
+static void eval_mm_moves(trace_t *trace, stats_t *stats);
+static void eval_ctrace_speed(void *ptr);
+static void run_ctrace(void);
 
 /* Various helper routines */
+static void dump_events(int tracenum, int num_tracefiles);
+static void print_phases(const trace_t *trace, speed_t *speed_params);
+static void print_cachesim(trace_t *trace);
+static void print_cachesim_counts(const char *label,
+                                  const mm_cachesim_counts_t *c, long ops);
 static void printresults(int n, stats_t *stats, sum_stats_t *sumstats);
+static void printmoves(int n, stats_t *stats);
 static void usage(void);
 static void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
     __attribute__((format(printf, 3,4)));
@@ -235,7 +295,10 @@ static void run_tests(int num_tracefiles, const char *tracedir,
         } else {
             if (verbose > 1)
                 printf("Checking mm_malloc for correctness, ");
+            mm_event_reset();
             mm_stats[i].valid = eval_mm_valid(trace, &ranges);
+            if (event_file != NULL)
+                dump_events(i, num_tracefiles);
 
             if (onetime_flag) {
                 free_trace(trace);
@@ -246,11 +309,28 @@ static void run_tests(int num_tracefiles, const char *tracedir,
             if (verbose > 1)
                 printf("efficiency, ");
             mm_stats[i].util = eval_mm_util(trace, i);
+            if (suite != NULL)
+                suite_traces[i].heap = mem_heapsize();
             speed_params->trace = trace;
             speed_params->ranges = ranges;
             if (verbose > 1)
                 printf("and performance.\n");
             mm_stats[i].secs = fsecs(eval_mm_speed, speed_params);
+            if (phase_flag)
+                print_phases(trace, speed_params);
+            if (cachesim_flag)
+                print_cachesim(trace);
+            if (fault_flag)
+                eval_mm_faults(trace, &mm_stats[i]);
+            if (moves_flag)
+                eval_mm_moves(trace, &mm_stats[i]);
+            if (suite != NULL) {
+                suite_traces[i].valid = 1;
+                suite_traces[i].ops = trace->num_ops;
+                suite_traces[i].secs = mm_stats[i].secs;
+                suite_traces[i].util = mm_stats[i].util;
+                eval_mm_latency(trace, &suite_traces[i]);
+            }
         }
 
         free_trace(trace);
@@ -290,7 +370,7 @@ int main(int argc, char **argv)
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hVAlD")) != EOF) {
+    while ((c = getopt(argc, argv, "b:d:e:f:c:s:t:v:L:M:hVAlDpCSFR")) != EOF) {
         switch (c) {
 
         case 'A': /* Hidden Autolab driver argument */
@@ -298,6 +378,10 @@ int main(int argc, char **argv)
             break;
 
         case 'f': /* Use one specific trace file only (relative to curr dir) */
+            if (suite != NULL) {
+                fprintf(stderr, "-M cannot be combined with -f or -c\n");
+                exit(1);
+            }
             num_tracefiles = 1;
             if ((tracefiles = realloc(tracefiles, 2 * sizeof(char *))) == NULL)
                 unix_error("ERROR: realloc failed in main");
@@ -307,6 +391,10 @@ int main(int argc, char **argv)
             break;
 
         case 'c': /* Use one specific trace file and run only once */
+            if (suite != NULL) {
+                fprintf(stderr, "-M cannot be combined with -f or -c\n");
+                exit(1);
+            }
             num_tracefiles = 1;
             onetime_flag = 1;
             if ((tracefiles = realloc(tracefiles, 2 * sizeof(char *))) == NULL)
@@ -348,6 +436,61 @@ int main(int argc, char **argv)
             set_timeout = atoi(optarg);
             break;
 
+        case 'e': /* Dump allocator events (needs an MM_EVENTS build) */
+            event_file = strdup(optarg);
+            break;
+
+        case 'b': /* Run a placement benchmark (see mmbench.c) */
+            bench_name = strdup(optarg);
+            break;
+
+        case 'S': /* Simulated cache misses (needs an MM_CACHESIM build) */
+            if (!mm_cachesim_enabled()) {
+                fprintf(stderr, "-S needs an allocator built with "
+                        "-DMM_CACHESIM\n");
+                exit(1);
+            }
+            cachesim_flag = 1;
+            break;
+
+        case 'M': /* Score the build on a suite manifest (see mmsuite.h) */
+            if (tracefiles != NULL) {
+                fprintf(stderr, "-M cannot be combined with -f or -c\n");
+                exit(1);
+            }
+            if ((suite = malloc(sizeof(*suite))) == NULL)
+                unix_error("ERROR: malloc failed in main");
+            if (mm_suite_read(optarg, suite) < 0)
+                exit(1);
+            tracefiles = suite->traces;
+            num_tracefiles = suite->ntraces;
+            break;
+
+        case 'L': /* Name of this build in the suite's results */
+            suite_label = strdup(optarg);
+            break;
+
+        case 'F': /* Page faults and pages touched of each trace */
+            fault_flag = 1;
+            break;
+
+        case 'R': /* Copy rate of the reallocs that move their block */
+            moves_flag = 1;
+            break;
+
+        case 'C': /* Time the compiled-in trace (see ctrace.h) */
+            ctrace_flag = 1;
+            break;
+
+        case 'p': /* Per-phase cycle breakdown (needs an MM_PHASES build) */
+            if (!mm_phase_enabled()) {
+                fprintf(stderr, "-p needs an allocator built with "
+                        "-DMM_PHASES\n");
+                exit(1);
+            }
+            phase_flag = 1;
+            break;
+
         case 'h': /* Print this message */
             usage();
             exit(0);
@@ -358,6 +501,41 @@ int main(int argc, char **argv)
         }
     }
 
+    if (suite != NULL) {
+        if (suite_label == NULL)
+            suite_label = strrchr(argv[0], '/') != NULL ?
+                strrchr(argv[0], '/') + 1 : argv[0];
+        suite_traces = calloc(num_tracefiles, sizeof(*suite_traces));
+        if (suite_traces == NULL)
+            unix_error("suite_traces calloc in main failed");
+    }
+
+    if (bench_name != NULL) {
+        init_fsecs();
+        if (mm_bench_run(bench_name) < 0) {
+            fprintf(stderr, "unknown benchmark %s; try one of:\n",
+                    bench_name);
+            mm_bench_list(stderr);
+            exit(1);
+        }
+        exit(0);
+    }
+
+    if (ctrace_flag) {
+        run_ctrace();
+        exit(0);
+    }
+
+    /* Simulated cache sets depend on addresses, so make them the same on
+       every run */
+    if (cachesim_flag) {
+        int pers = personality(0xffffffff);
+
+        if (pers != -1 && !(pers & ADDR_NO_RANDOMIZE) &&
+            personality(pers | ADDR_NO_RANDOMIZE) != -1)
+            execv("/proc/self/exe", argv);
+    }
+
     if (tracefiles == NULL) {
         tracefiles = default_tracefiles;
         num_tracefiles = sizeof(default_tracefiles) / sizeof(char *) - 1;
@@ -440,9 +618,19 @@ int main(int argc, char **argv)
         } else {
             printf("\nResults for mm malloc:\n");
             printresults(num_tracefiles, mm_stats, &global_mm_sum_stats);
+            if (moves_flag)
+                printmoves(num_tracefiles, mm_stats);
             printf("\n");
         }
     }
+    if (cachesim_flag && num_tracefiles > 1) {
+        printf("Simulated misses, all traces (%ld ops):\n", cachesim_ops);
+        print_cachesim_counts("metadata", &cachesim_total[CS_META],
+                              cachesim_ops);
+        print_cachesim_counts("payload", &cachesim_total[CS_PAYLOAD],
+                              cachesim_ops);
+        printf("\n");
+    }
 
     /* Optionally compare the performance of mm and libc */
     if (run_libc) {
@@ -551,6 +739,16 @@ int main(int argc, char **argv)
         printf("Terminated with %d errors\n", errors);
     }
 
+    /* Score the build on the production mix of the suite */
+    if (suite != NULL) {
+        mm_suite_result_t result;
+
+        mm_suite_score(suite, suite_traces, &result);
+        printf("\n");
+        mm_suite_print(suite, &result);
+        mm_suite_rank(suite, suite_label, &result);
+    }
+
     /* Optionally emit autoresult string */
     double raw_score = perfindex;
     if (raw_score < PERF_THRESHHOLD) {
@@ -596,8 +794,7 @@ static int add_range(range_t **ranges, char *lo, int size,
     }
 
     /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
-        (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    if (!mem_in_heap(lo, hi)) {
         malloc_error(trace, opnum,
                      "Payload (%p:%p) lies outside heap (%p:%p)",
                      lo, hi, mem_heap_lo(), mem_heap_hi());
@@ -1144,6 +1341,215 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+/*
+ * replay_trace - run the trace once on a fresh heap, outside the timed
+ *     and checked runs, for the measurements that need a replay of their
+ *     own. hook (if not NULL) is called with opnum -1 on the reset heap
+ *     before mm_init, then after every op with the block it returned
+ *     (NULL for a free) and the cycles it took; trace->blocks and
+ *     trace->block_sizes still hold what they held before the op.
+ */
+static void replay_trace(trace_t *trace, replay_hook_t hook, void *ctx)
+{
+    static const char *opname[] = {
+        [ALLOC] = "mm_malloc", [FREE] = "mm_free", [REALLOC] = "mm_realloc",
+    };
+    traceop_t *op;
+    uint64_t t0;
+    char *p;
+    int i;
+
+    reinit_trace(trace);
+    mem_reset_brk();
+    if (hook != NULL)
+        hook(trace, -1, NULL, 0, ctx);
+    if (mm_init() < 0)
+        app_error("mm_init failed replaying %s", trace->filename);
+
+    for (i = 0; i < trace->num_ops; i++) {
+        op = &trace->ops[i];
+        t0 = __builtin_ia32_rdtsc();
+        switch (op->type) {
+        case ALLOC:
+            p = mm_malloc(op->size);
+            break;
+        case REALLOC:
+            p = mm_realloc(trace->blocks[op->index], op->size);
+            break;
+        case FREE:
+            mm_free(op->index < 0 ? NULL : trace->blocks[op->index]);
+            p = NULL;
+            break;
+        default:
+            app_error("Nonexistent request type replaying %s",
+                      trace->filename);
+        }
+        t0 = __builtin_ia32_rdtsc() - t0;
+        if (p == NULL && op->type != FREE && op->size != 0)
+            app_error("%s failed at op %d replaying %s", opname[op->type],
+                      i, trace->filename);
+        if (hook != NULL)
+            hook(trace, i, p, t0, ctx);
+        if (op->type != FREE) {
+            trace->blocks[op->index] = p;
+            trace->block_sizes[op->index] = op->size;
+        }
+    }
+}
+
+static int cmp_uint32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return x < y ? -1 : (x > y);
+}
+
+/*
+ * latency_hook - keep each op's cycles
+ */
+static void latency_hook(trace_t *trace, int opnum, char *p, uint64_t cycles,
+                         void *ctx)
+{
+    mm_suite_trace_t *st = ctx;
+
+    if (opnum >= 0)
+        st->lat[opnum] = cycles;
+}
+
+/*
+ * eval_mm_latency - replay the trace once more, timing each op with
+ *     the cycle counter, and leave the sorted cycles in st->lat for the
+ *     suite's tail latency
+ */
+static void eval_mm_latency(trace_t *trace, mm_suite_trace_t *st)
+{
+    if ((st->lat = malloc(trace->num_ops * sizeof(*st->lat))) == NULL)
+        unix_error("malloc failed in eval_mm_latency");
+    replay_trace(trace, latency_hook, st);
+    qsort(st->lat, trace->num_ops, sizeof(*st->lat), cmp_uint32);
+}
+
+/*
+ * faults_hook - start counting on the emptied heap, before mm_init
+ */
+static void faults_hook(trace_t *trace, int opnum, char *p, uint64_t cycles,
+                        void *ctx)
+{
+    if (opnum < 0) {
+        mem_touch_begin();
+        getrusage(RUSAGE_SELF, ctx);
+    }
+}
+
+/*
+ * eval_mm_faults - replay the trace once more on a heap whose pages were
+ *     all returned to the system, and record the page faults it took and
+ *     the heap pages it touched: the kernel's share of the cost, which
+ *     the timed runs, reusing a warm heap, do not see
+ */
+static void eval_mm_faults(trace_t *trace, stats_t *stats)
+{
+    struct rusage before, after;
+
+    replay_trace(trace, faults_hook, &before);
+    getrusage(RUSAGE_SELF, &after);
+    stats->paged = 1;
+    stats->minflt = after.ru_minflt - before.ru_minflt;
+    stats->majflt = after.ru_majflt - before.ru_majflt;
+    stats->pages = mem_touch_end();
+}
+
+/*
+ * moves_hook - count a realloc that moved its block, with the payload
+ *     bytes it had to copy and its cycles
+ */
+static void moves_hook(trace_t *trace, int opnum, char *p, uint64_t cycles,
+                       void *ctx)
+{
+    stats_t *stats = ctx;
+    traceop_t *op;
+    char *oldp;
+
+    if (opnum < 0 || (op = &trace->ops[opnum])->type != REALLOC)
+        return;
+    oldp = trace->blocks[op->index];
+    if (oldp != NULL && p != NULL && p != oldp) {
+        stats->moves++;
+        stats->move_bytes += op->size < trace->block_sizes[op->index] ?
+            op->size : trace->block_sizes[op->index];
+        stats->move_secs += cycles;
+    }
+}
+
+/*
+ * eval_mm_moves - replay the trace once more, timing each realloc that
+ *     moves its block, and record how many payload bytes those moved
+ *     and how long they took, for the realloc copy rate
+ */
+static void eval_mm_moves(trace_t *trace, stats_t *stats)
+{
+    stats->move_secs = 0;           /* in cycles until the end */
+    replay_trace(trace, moves_hook, stats);
+    stats->move_secs /= mhz(0) * 1e6;
+}
+
+/*
+ * eval_ctrace_speed - replay the compiled-in trace, for fcyc()
+ */
+static void eval_ctrace_speed(void *ptr)
+{
+    const ctrace_t *ct = ptr;
+    int i;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("mm_init failed in eval_ctrace_speed");
+    ct->reset();
+    for (i = 0; i < ct->nfuncs; i++)
+        ct->funcs[i]();
+}
+
+/*
+ * run_ctrace - check the trace compiled in with trace2c using the
+ *     interpreter, then time its interpreted and compiled replays
+ */
+static void run_ctrace(void)
+{
+    stats_t stats;
+    speed_t speed_params;
+    range_t *ranges = NULL;
+    trace_t *trace;
+    double isecs, csecs;
+
+    if (&mm_ctrace == NULL)
+        app_error("no compiled trace is linked in; build mdriver-ctrace "
+                  "with \"make mdriver-ctrace TRACE=<file>\"");
+    if (debug_mode != DBG_NONE)
+        init_random_data();
+    init_fsecs();
+    mem_init();
+
+    trace = read_trace(&stats, "", mm_ctrace.name);
+    if (!eval_mm_valid(trace, &ranges))
+        app_error("%s is not valid; not timing it", mm_ctrace.name);
+    clear_ranges(&ranges);
+
+    speed_params.trace = trace;
+    speed_params.ranges = NULL;
+    isecs = fsecs(eval_mm_speed, &speed_params);
+    csecs = fsecs(eval_ctrace_speed, (void *)&mm_ctrace);
+
+    printf("%s: %d ops\n", mm_ctrace.name, mm_ctrace.num_ops);
+    printf("  interpreted %10.6f secs %8.0f Kops\n", isecs,
+           mm_ctrace.num_ops / 1e3 / isecs);
+    printf("  compiled    %10.6f secs %8.0f Kops\n", csecs,
+           mm_ctrace.num_ops / 1e3 / csecs);
+    printf("  interpreter overhead %.1f%%\n", 100 * (isecs - csecs) / isecs);
+
+    free_trace(trace);
+    mem_deinit();
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -1245,6 +1651,150 @@ static void eval_libc_speed(void *ptr)
  * Some miscellaneous helper routines
  ************************************/
 
+/*
+ * dump_events - write the events recorded during the correctness run
+ *     of trace tracenum to event_file, or to event_file.<tracenum> when
+ *     several traces are run. Decode the result with evdecode.
+ */
+static void dump_events(int tracenum, int num_tracefiles)
+{
+    char path[MAXLINE];
+
+    if (num_tracefiles == 1)
+        snprintf(path, sizeof(path), "%s", event_file);
+    else
+        snprintf(path, sizeof(path), "%s.%d", event_file, tracenum);
+
+    if (mm_event_dump(path) < 0)
+        fprintf(stderr, "Could not dump events to %s "
+                "(is the allocator built with -DMM_EVENTS?)\n", path);
+}
+
+/*
+ * print_phases - run the trace once more with the phase accumulators
+ *     cleared and print how its cycles split across the allocator's
+ *     internal phases. Self cycles exclude nested phases, so the self
+ *     column adds up to the time spent inside the allocator.
+ */
+static void print_phases(const trace_t *trace, speed_t *speed_params)
+{
+    uint64_t total = 0;
+    int ph;
+
+    mm_phase_reset();
+    eval_mm_speed(speed_params);
+
+    for (ph = 0; ph < PH_NPHASES; ph++)
+        total += mm_phases[ph].self;
+    if (total == 0)
+        total = 1;
+
+    printf("\nPhase breakdown for %s (%d ops):\n",
+           trace->filename, trace->num_ops);
+    printf("  %-10s%10s%12s%12s%8s\n",
+           "phase", "calls", "cyc/call", "self/op", "self%");
+    for (ph = 0; ph < PH_NPHASES; ph++) {
+        const mm_phase_t *p = &mm_phases[ph];
+
+        if (p->calls == 0)
+            continue;
+        printf("  %-10s%10lu%12.1f%12.1f%7.1f%%\n", mm_phase_name(ph),
+               (unsigned long)p->calls, (double)p->cycles / p->calls,
+               (double)p->self / trace->num_ops,
+               100.0 * p->self / total);
+    }
+    printf("  %-10s%10s%12s%12.1f\n", "total", "", "",
+           (double)total / trace->num_ops);
+}
+
+
+/*
+ * cachesim_hook - start from empty caches and write each payload when
+ *     it is allocated
+ */
+static void cachesim_hook(trace_t *trace, int opnum, char *p,
+                          uint64_t cycles, void *ctx)
+{
+    if (opnum < 0)
+        mm_cachesim_reset();
+    else if (p != NULL)
+        mm_cachesim_touch(p, trace->ops[opnum].size, CS_PAYLOAD);
+}
+
+/*
+ * print_cachesim - replay the trace once through the cache simulator,
+ *     writing each payload when it is allocated, and print the misses
+ *     of the allocator's metadata accesses and of the payload writes
+ */
+static void print_cachesim(trace_t *trace)
+{
+    int k, lv;
+
+    replay_trace(trace, cachesim_hook, NULL);
+
+    printf("\nSimulated misses for %s (%d ops):\n",
+           trace->filename, trace->num_ops);
+    printf("  %s\n", mm_cachesim_config());
+    print_cachesim_counts("metadata", &mm_cachesim[CS_META],
+                          trace->num_ops);
+    print_cachesim_counts("payload", &mm_cachesim[CS_PAYLOAD],
+                          trace->num_ops);
+
+    cachesim_ops += trace->num_ops;
+    for (k = 0; k < CS_NKINDS; k++) {
+        cachesim_total[k].accesses += mm_cachesim[k].accesses;
+        for (lv = 0; lv < CS_NLEVELS; lv++)
+            cachesim_total[k].miss[lv] += mm_cachesim[k].miss[lv];
+    }
+}
+
+/*
+ * print_cachesim_counts - one table of simulated misses: totals and
+ *     per op
+ */
+static void print_cachesim_counts(const char *label,
+                                  const mm_cachesim_counts_t *c, long ops)
+{
+    int lv;
+
+    printf("  %-10s%12s%10s\n", label, "total", "per op");
+    printf("  %-10s%12lu%10.2f\n", "lines", (unsigned long)c->accesses,
+           (double)c->accesses / ops);
+    for (lv = 0; lv < CS_NLEVELS; lv++)
+        printf("  %-10s%12lu%10.3f\n", mm_cachesim_level(lv),
+               (unsigned long)c->miss[lv], (double)c->miss[lv] / ops);
+}
+
+/*
+ * printmoves - the traces whose reallocs moved blocks, with the rate
+ *     at which those reallocs moved payload bytes
+ */
+static void printmoves(int n, stats_t *stats)
+{
+    double moves = 0, bytes = 0, secs = 0;
+    int i;
+
+    for (i = 0; i < n; i++)
+        if (stats[i].valid && stats[i].moves > 0)
+            break;
+    if (i == n)
+        return;
+    printf("\nRealloc moves:\n");
+    printf("  %8s %10s %8s  %s\n", "moves", "MB", "GB/s", "trace");
+    for (; i < n; i++) {
+        if (!stats[i].valid || stats[i].moves == 0)
+            continue;
+        printf("  %8.0f %10.2f %8.2f  %s\n", stats[i].moves,
+               stats[i].move_bytes / 1e6,
+               stats[i].move_bytes / 1e9 / stats[i].move_secs,
+               stats[i].filename);
+        moves += stats[i].moves;
+        bytes += stats[i].move_bytes;
+        secs += stats[i].move_secs;
+    }
+    printf("  %8.0f %10.2f %8.2f  total\n", moves, bytes / 1e6,
+           bytes / 1e9 / secs);
+}
 
 /*
  * printresults - prints a performance summary for some malloc package and returns
@@ -1261,11 +1811,16 @@ static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
     int sum_perf_weight = 0;
     int sum_util_weight = 0;
 
+    /* fault sums of the traces measured with -F */
+    double sumflt = 0, summaj = 0, sumpages = 0, sumfltops = 0;
+
     char wstr;
 
     /* Print the individual results for each trace */
-    printf("  %2s%6s %5s%8s%9s  %s\n",
-           "valid", "util", "ops", "secs", "Kops", "trace");
+    printf("  %2s%6s %5s%8s%9s", "valid", "util", "ops", "secs", "Kops");
+    if (fault_flag)
+        printf("%8s%6s%7s", "flt/op", "major", "pages");
+    printf("  %s\n", "trace");
     for (i=0; i < n; i++) {
         if (stats[i].valid) {
             switch(stats[i].weight)
@@ -1307,6 +1862,19 @@ static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
             else
                 printf("%8s%10s%6s", "--", "--", "--");
 
+            /* faults per op, next to the Kops they cost */
+            if (fault_flag && stats[i].paged) {
+                printf("%8.3f%6.0f%7.0f",
+                       (stats[i].minflt + stats[i].majflt) / stats[i].ops,
+                       stats[i].majflt, stats[i].pages);
+                sumflt += stats[i].minflt + stats[i].majflt;
+                summaj += stats[i].majflt;
+                sumpages += stats[i].pages;
+                sumfltops += stats[i].ops;
+            } else if (fault_flag) {
+                printf("%8s%6s%7s", "--", "--", "--");
+            }
+
             printf(" %s\n", stats[i].filename);
 
             if(stats[i].weight == WALL || stats[i].weight == WPERF)
@@ -1342,13 +1910,16 @@ static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
 
         double util = (sumutil/(double)sum_util_weight)*100.0;
         double tput = (sumsecs==0.0) ? 0 : (sumops/1e3)/sumsecs;
-        printf("%2d %2d  %5.0f%%%8.0f%10.6f%6.0f\n",
+        printf("%2d %2d  %5.0f%%%8.0f%10.6f%6.0f",
                sum_util_weight,
                sum_perf_weight,
                util,
                sumops,
                sumsecs,
                tput);
+        if (fault_flag && sumfltops > 0)
+            printf("%8.3f%6.0f%7.0f", sumflt / sumfltops, summaj, sumpages);
+        printf("\n");
 
         /* Record the summary statistics so we can compare libc and
            mm.cc */
@@ -1417,12 +1988,23 @@ void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
  */
 static void usage(void)
 {
-    fprintf(stderr, "Usage: mdriver [-hlVdD] [-f <file>]\n");
+    fprintf(stderr, "Usage: mdriver [-hlVdDpCSFR] [-f <file>] [-e <file>] "
+            "[-b <bench>] [-M <file> [-L <name>]]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-d <i>     Debug: 0 off; 1 default; 2 lots.\n");
     fprintf(stderr, "\t-D         Equivalent to -d2.\n");
+    fprintf(stderr, "\t-b <bench> Run a payload-touching benchmark:\n");
+    mm_bench_list(stderr);
     fprintf(stderr, "\t-c <file>  Run trace file <file> once, check for correctness only.\n");
+    fprintf(stderr, "\t-C         Time the trace compiled in with trace2c (mdriver-ctrace).\n");
+    fprintf(stderr, "\t-e <file>  Dump allocator events of each trace to <file>.\n");
+    fprintf(stderr, "\t-p         Print a per-phase cycle breakdown of each trace.\n");
+    fprintf(stderr, "\t-S         Print simulated cache and TLB misses of each trace.\n");
+    fprintf(stderr, "\t-F         Print the page faults and pages touched of each trace.\n");
+    fprintf(stderr, "\t-R         Print the copy rate of the reallocs that move blocks.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-M <file>  Score the build on the weighted traces of a suite manifest.\n");
+    fprintf(stderr, "\t-L <name>  Record the build as <name> in the suite's results.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
     fprintf(stderr, "\t-V         Print diagnostics as each trace is run.\n");
@@ -11,36 +11,140 @@
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "memlib.h"
 #include "config.h"
 
+/* Segments are mapped in a window reserved above the brk heap, so that
+   every heap address stays within 4 GB of the heap start */
+#define ADDR_SPACE ((size_t)4 << 30)
+#define SEG_WINDOW (ADDR_SPACE - heap_max)
+#define MAX_SEGS 4096
+
+/* MM_HEAP_SIZE may raise the brk heap's size up to HEAP_LIMIT, leaving
+   the rest of the 4 GB to segments */
+#define HEAP_LIMIT ((size_t)3 << 30)
+
 /* private variables */
+static int heap_fd = -1;		/* backing file (MM_HEAP_FILE), or -1 */
 static char *heap;
+static size_t heap_max;			/* size of the brk heap's mapping */
 static char *mem_brk;
 static char *mem_max_addr;
+static char *window;			/* segment window, or NULL */
+static struct {
+	char *base;
+	size_t size;
+} segs[MAX_SEGS];				/* mapped segments, by address */
+static int nsegs;
+static size_t seg_bytes;		/* bytes in mapped segments */
+static size_t seg_peak;			/* most bytes in segments at once */
+static int counting;			/* between mem_touch_begin and _end */
+static size_t seg_touched;		/* pages touched in unmapped segments */
+
+/*
+ * heap_size - the size of the brk heap: MAX_HEAP, or MM_HEAP_SIZE=n
+ *		bytes (with an optional K, M or G suffix) up to HEAP_LIMIT
+ */
+static size_t heap_size(void){
+	const char *env = getenv("MM_HEAP_SIZE");
+	size_t pagesize = mem_pagesize();
+	size_t size;
+	char *end;
+
+	if(env == NULL){
+		return MAX_HEAP;
+	}
+	size = strtoul(env, &end, 0);
+	switch(*end){
+	case 'k': case 'K': size <<= 10; break;
+	case 'm': case 'M': size <<= 20; break;
+	case 'g': case 'G': size <<= 30; break;
+	}
+	if(size == 0){
+		return MAX_HEAP;
+	}
+	size = (size + pagesize - 1) & ~(pagesize - 1);
+	return size < HEAP_LIMIT ? size : HEAP_LIMIT;
+}
+
+/*
+ * file_reserve - makes the heap file at least len bytes long, growing it
+ *		sparsely; a longer file is left as it is. Returns -1 on failure.
+ */
+static int file_reserve(size_t len){
+	struct stat st;
+
+	if(fstat(heap_fd, &st) < 0){
+		return -1;
+	}
+	if((size_t)st.st_size >= len){
+		return 0;
+	}
+	return ftruncate(heap_fd, len);
+}
 
 /* 
- * mem_init - initialize the memory system model
+ * mem_init - initialize the memory system model. If MM_HEAP_FILE names a
+ *		file, the heap is that file mapped shared (created, and grown
+ *		sparsely to the heap size if it is shorter), so that it is paged
+ *		to the file rather than to swap. File offsets match offsets from
+ *		the heap start, so segments map their part of the same file.
  */
 void mem_init(void){
-	int dev_zero = open("/dev/zero", O_RDWR);
-	heap = mmap((void *)0x800000000, /* suggested start*/
-			MAX_HEAP,				/* length */
-			PROT_WRITE,				/* permissions */
-			MAP_PRIVATE,			/* private or shared? */
-			dev_zero,				/* fd */
-			0);						/* offset (dunno) */
-	mem_max_addr = heap + MAX_HEAP;
+	const char *path = getenv("MM_HEAP_FILE");
+
+	heap = MAP_FAILED;
+	heap_max = heap_size();
+	if(path != NULL){
+		if((heap_fd = open(path, O_RDWR | O_CREAT, 0600)) < 0 ||
+				file_reserve(heap_max) < 0){
+			perror(path);
+		} else {
+			heap = mmap((void *)0x800000000, heap_max,
+					PROT_READ | PROT_WRITE, MAP_SHARED, heap_fd, 0);
+		}
+		if(heap == MAP_FAILED && heap_fd >= 0){
+			close(heap_fd);
+			heap_fd = -1;
+		}
+	}
+	if(heap == MAP_FAILED){
+		int dev_zero = open("/dev/zero", O_RDWR);
+		heap = mmap((void *)0x800000000, /* suggested start*/
+				heap_max,				/* length */
+				PROT_WRITE,				/* permissions */
+				MAP_PRIVATE,			/* private or shared? */
+				dev_zero,				/* fd */
+				0);						/* offset (dunno) */
+	}
+	mem_max_addr = heap + heap_max;
 	mem_brk = heap;					/* heap is empty initially */
+	window = mmap(mem_max_addr, SEG_WINDOW, PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED_NOREPLACE,
+			-1, 0);
+	if(window == MAP_FAILED){
+		window = NULL;
+	}
+	nsegs = 0;
+	seg_bytes = seg_peak = 0;
 }
 
 /* 
  * mem_deinit - free the storage used by the memory system model
  */
 void mem_deinit(void){
-	munmap(heap, MAX_HEAP);
+	munmap(heap, heap_max);
+	if(heap_fd >= 0){
+		close(heap_fd);
+		heap_fd = -1;
+	}
+	if(window != NULL){
+		munmap(window, SEG_WINDOW);
+		window = NULL;
+	}
 }
 
 /*
@@ -48,6 +152,10 @@ void mem_deinit(void){
  */
 void mem_reset_brk(){
 	mem_brk = heap;
+	while(nsegs > 0){
+		mem_unmap_segment(segs[0].base);
+	}
+	seg_peak = 0;
 }
 
 /* 
@@ -85,10 +193,180 @@ void *mem_heap_hi(){
 }
 
 /*
- * mem_heapsize() - returns the heap size in bytes
+ * mem_heapsize() - returns the heap size in bytes: the brk heap plus the
+ *		most bytes that were mapped in segments at once
  */
 size_t mem_heapsize() {
-	return (size_t)((void *)mem_brk - (void *)heap);
+	return (size_t)((void *)mem_brk - (void *)heap) + seg_peak;
+}
+
+/*
+ * mem_map_segment - maps a segment of size bytes (a multiple of the page
+ *		size) at the lowest free address of the segment window, or returns
+ *		NULL. With a heap file the segment is the file's part at the same
+ *		offset from the heap start.
+ */
+void *mem_map_segment(size_t size){
+	char *base = window;
+	int i;
+
+	if(window == NULL || nsegs == MAX_SEGS){
+		return NULL;
+	}
+	for(i = 0; i < nsegs && (size_t)(segs[i].base - base) < size; i++){
+		base = segs[i].base + segs[i].size;
+	}
+	if(base + size > window + SEG_WINDOW){
+		return NULL;
+	}
+	if(heap_fd >= 0){
+		if(file_reserve(base + size - heap) < 0 ||
+				mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+					heap_fd, base - heap) == MAP_FAILED){
+			return NULL;
+		}
+	} else if(mmap(base, size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED){
+		return NULL;
+	}
+	memmove(&segs[i + 1], &segs[i], (nsegs - i) * sizeof(segs[0]));
+	segs[i].base = base;
+	segs[i].size = size;
+	nsegs++;
+	seg_bytes += size;
+	if(seg_bytes > seg_peak){
+		seg_peak = seg_bytes;
+	}
+	return base;
+}
+
+/*
+ * resident_pages - returns how many of the pages of len bytes at base
+ *		(page-aligned) are resident
+ */
+static size_t resident_pages(char *base, size_t len){
+	size_t pagesize = mem_pagesize();
+	size_t i, n = (len + pagesize - 1) / pagesize, pages = 0;
+	unsigned char *vec;
+
+	if(n == 0 || (vec = malloc(n)) == NULL){
+		return 0;
+	}
+	if(mincore(base, len, vec) == 0){
+		for(i = 0; i < n; i++){
+			pages += vec[i] & 1;
+		}
+	}
+	free(vec);
+	return pages;
+}
+
+/*
+ * mem_unmap_segment - returns the memory of the segment at base to the
+ *		system, keeping its addresses reserved. A file-backed segment's
+ *		part of the file is kept for the next segment mapped there:
+ *		punching it out costs more than the mapping itself.
+ */
+void mem_unmap_segment(void *base){
+	int i;
+
+	for(i = 0; i < nsegs && segs[i].base != base; i++)
+		;
+	if(i == nsegs){
+		return;
+	}
+	if(counting){
+		seg_touched += resident_pages(base, segs[i].size);
+	}
+	mmap(base, segs[i].size, PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+	seg_bytes -= segs[i].size;
+	nsegs--;
+	memmove(&segs[i], &segs[i + 1], (nsegs - i) * sizeof(segs[0]));
+}
+
+/*
+ * mem_segment - returns the base of the i-th mapped segment (by address)
+ *		and stores its size, or returns NULL past the last one
+ */
+void *mem_segment(int i, size_t *size){
+	if(i >= nsegs){
+		return NULL;
+	}
+	*size = segs[i].size;
+	return segs[i].base;
+}
+
+/*
+ * mem_advise - madvise()s the pages overlapping len bytes at p, or with
+ *		p NULL the whole heap and every segment; returns -1 on failure
+ */
+int mem_advise(void *p, size_t len, int advice){
+	size_t pagesize = mem_pagesize();
+	char *lo, *hi;
+	int i, rc = 0;
+
+	if(p == NULL){
+		rc = mem_advise(heap, mem_brk - heap, advice);
+		for(i = 0; i < nsegs; i++){
+			rc |= mem_advise(segs[i].base, segs[i].size, advice);
+		}
+		return rc;
+	}
+	if(len == 0){
+		return 0;
+	}
+	lo = (char *)((size_t)p & ~(pagesize - 1));
+	hi = (char *)(((size_t)p + len + pagesize - 1) & ~(pagesize - 1));
+	return madvise(lo, hi - lo, advice);
+}
+
+/*
+ * mem_sync - writes the dirty pages overlapping len bytes at p, or with
+ *		p NULL the whole heap and every segment, back to the heap file and
+ *		waits for them; returns -1 on failure. Does nothing without a heap
+ *		file.
+ */
+int mem_sync(void *p, size_t len){
+	size_t pagesize = mem_pagesize();
+	char *lo, *hi;
+	int i, rc;
+
+	if(heap_fd < 0){
+		return 0;
+	}
+	if(p == NULL){
+		rc = mem_sync(heap, mem_brk - heap);
+		for(i = 0; i < nsegs; i++){
+			rc |= mem_sync(segs[i].base, segs[i].size);
+		}
+		return rc;
+	}
+	if(len == 0 || !mem_in_heap(p, (char *)p + len - 1)){
+		return 0;
+	}
+	lo = (char *)((size_t)p & ~(pagesize - 1));
+	hi = (char *)(((size_t)p + len + pagesize - 1) & ~(pagesize - 1));
+	return msync(lo, hi - lo, MS_SYNC);
+}
+
+/*
+ * mem_in_heap - returns whether the bytes lo..hi lie within the brk heap
+ *		or within one segment
+ */
+int mem_in_heap(const void *lo, const void *hi){
+	int i;
+
+	if((char *)lo >= heap && (char *)hi < mem_brk){
+		return 1;
+	}
+	for(i = 0; i < nsegs; i++){
+		if((char *)lo >= segs[i].base &&
+				(char *)hi < segs[i].base + segs[i].size){
+			return 1;
+		}
+	}
+	return 0;
 }
 
 /*
@@ -97,3 +375,35 @@ size_t mem_heapsize() {
 size_t mem_pagesize(){
 	return (size_t)getpagesize();
 }
+
+/*
+ * mem_touch_begin - returns every page of the brk heap to the system, so
+ *		that the next access to each one faults it in afresh (from the
+ *		heap file, with MM_HEAP_FILE), and starts counting the pages
+ *		touched. Call it on an empty heap, after mem_reset_brk.
+ */
+void mem_touch_begin(void){
+	madvise(heap, heap_max, MADV_DONTNEED);
+	counting = 1;
+	seg_touched = 0;
+}
+
+/*
+ * mem_touch_end - returns how many heap and segment pages have been
+ *		touched since mem_touch_begin, including those of segments
+ *		unmapped in between, and stops counting. With MM_HEAP_FILE,
+ *		mincore sees the file's cached pages, touched or not.
+ */
+size_t mem_touch_end(void){
+	size_t pagesize = mem_pagesize();
+	size_t pages = seg_touched;
+	int i;
+
+	pages += resident_pages(heap, (mem_brk - heap + pagesize - 1) &
+			~(pagesize - 1));
+	for(i = 0; i < nsegs; i++){
+		pages += resident_pages(segs[i].base, segs[i].size);
+	}
+	counting = 0;
+	return pages;
+}
@@ -9,3 +9,16 @@ void *mem_heap_hi(void);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
 
+/* Separately mapped heap segments */
+void *mem_map_segment(size_t size);
+void mem_unmap_segment(void *base);
+void *mem_segment(int i, size_t *size);
+int mem_in_heap(const void *lo, const void *hi);
+
+/* Page-granular madvise and msync (p NULL: the whole heap) */
+int mem_advise(void *p, size_t len, int advice);
+int mem_sync(void *p, size_t len);
+
+/* Pages first touched between the two calls (mincore) */
+void mem_touch_begin(void);
+size_t mem_touch_end(void);
@@ -26,14 +26,19 @@
  * segregated list technique. Free block lists are stored in an array of linked
  * list for different sizes of free blocks. There is no limit on size of these 
  * linked lists. 
- * freeblocklist[0] contains free blocks of size <=16
- * freeblocklist[1] : size between 2^4 to 2^5
- * freeblocklist[2] : size between 2^5 - 2^6 
+ * freeblocklist[0] contains free blocks of size 16
+ * freeblocklist[1] : size 16 + ALIGNMENT
+ * and so on in steps of ALIGNMENT up to SMALLBIN_MAX (512). Above that:
+ * freeblocklist[NSMALLBINS] : size between 512 and 2^10
+ * freeblocklist[NSMALLBINS+1] : size between 2^10 - 2^11
  * and so on
  *
  * This reduces the number of searched required for a free block as now the 
  * allocator will only search in a particular linked list based on size of the 
  * block required which further results in increase in throughput.
+ * Any block in an exact-size bin fits a request of that size, and a bitmap
+ * of non-empty lists gives the nearest larger list directly, so small
+ * requests are served without walking any list.
  *
  * Coalescing:
  * ==========
@@ -42,21 +47,182 @@
  *
  * Fit: 
  * ====
- * Memory allocation is done using first fit model. When a memory block is 
- * requested, first appropriate list from the lists of free block lists is 
- * selected and then a free block of appropriate size is allocated from that 
- * list.
+ * When a memory block is requested, first appropriate list from the lists
+ * of free block lists is selected. Every block of an exact-size bin fits,
+ * and a power-of-two list is searched best fit: the smallest block that
+ * fits is taken, stopping early at an exact fit. If that list has no fit,
+ * the head of the next non-empty list is used.
+ *
+ * Hot sizes:
+ * ==========
+ * One in HOT_PERIOD requests above SMALLBIN_MAX is sampled into a small
+ * heavy-hitters table. A size that becomes hot gets one of NHOTBINS
+ * dedicated bins holding only blocks of exactly that size, and the bin is
+ * retired again when the size cools down, moving its blocks back to the
+ * size lists. A request that finds no fit in the size lists still takes a
+ * block from the smallest hot bin that is large enough before the heap is
+ * extended. The active sizes are published in mm_stats.hot_size.
  * 
  * Splitting
  * =========
- * If (size of free block - requested block size) >  MinBlockSize(16) we split 
- * the block and allocate. Also the remaining block is restored back in the 
+ * If (size of free block - requested block size) > SPLIT_MIN(24) we split
+ * the block and allocate. Smaller remainders stay with the block: split
+ * off, they fill the 16 and 24 byte bins with fragments few requests
+ * can use. Also the remaining block is restored back in the 
  * appropriate free list.
  *
  * Free:
  * =====
  *Freeing a block is essentially changing the allocated bits to free bits
  * and add the block in appropriate free list.  
+ *
+ * Alignment:
+ * ==========
+ * Payloads are aligned to ALIGNMENT bytes: 8, or 16 in a build with
+ * -DMM_ALIGN16 (alignof(max_align_t) on x86-64). The first block of the
+ * heap and of each segment starts 16 bytes in, so its payload is 16-
+ * aligned, and every block size is a multiple of ALIGNMENT, so every
+ * payload after it is too. The 4-byte header and footer stay as they
+ * are; the stricter alignment only costs the rounding of block sizes
+ * to 16 bytes, and the exact-size bins, slab classes and per-CPU cache
+ * classes step by ALIGNMENT as well.
+ *
+ * In-place resizing:
+ * ==================
+ * mm_try_resize grows a block without moving it, so that pointers into
+ * it stay valid: it absorbs the free block after it and, for a block
+ * at the top of the sbrk heap, extends the heap under it. It takes as
+ * much of the desired size as that allows, or nothing if even the
+ * minimum does not fit. Shrinking splits the tail off as a free block.
+ * Blocks in slabs, the page heap and guard slots keep their size.
+ *
+ * Locality hints:
+ * ===============
+ * mm_malloc_near(size, hint) walks the heap blocks on either side of the
+ * live block hint, at most NEAR_PROBES each way and within NEAR_RANGE
+ * bytes (a page), and takes the first free block there that fits before
+ * searching the free lists as malloc does. Nodes of a linked structure
+ * allocated next to their predecessor then share pages and cache lines
+ * rather than landing wherever the head of a free list happens to be.
+ *
+ * Event tracing:
+ * ==============
+ * Built with -DMM_EVENTS, splits, coalesces (with the case number), heap
+ * extensions, free list inserts/deletes and search probe counts are
+ * recorded through EVENT() into per-thread rings (see mmevent.h).
+ *
+ * Realloc copies:
+ * ===============
+ * A realloc that moves a block copies only the live payload (the
+ * smaller of the new size and the old usable size) through mm_copy
+ * (mmcopy.h): memcpy for most sizes, and prefetched non-temporal stores
+ * from half the last-level cache (or MM_COPY_NT=n) up, so that a huge
+ * move does not flush the cache.
+ *
+ * Cache simulation:
+ * =================
+ * Built with -DMM_CACHESIM, every header, footer and link word read or
+ * written through GET and PUT is also fed to the cache and TLB model of
+ * mmcachesim.h, which mdriver -S reports. Block copies in realloc and
+ * the slab and page heap bitmaps are not counted.
+ *
+ * Small objects:
+ * ==============
+ * With MM_SLAB=n in the environment (n at most SLAB_MAX), requests of up
+ * to n bytes are served from slab pages: page-aligned heap blocks whose
+ * payload is one page of equal-sized objects without headers or footers.
+ * Each slab page is described by a span (size, free-object bitmap) kept
+ * outside the heap and found through a radix-tree page map
+ * (mmpagemap.h), so free, realloc and mm_usable_size of a small object
+ * never touch memory next to it. A whole page per size class costs too
+ * much on small heaps, so this is off by default.
+ *
+ * Medium objects:
+ * ===============
+ * With MM_PAGES=n, requests from n bytes up to PAGES_MAX come from the
+ * page heap instead of the free lists. It takes page-aligned regions of
+ * REGION_PAGES pages from the heap and hands out runs of whole pages,
+ * rounded to a grid of page counts (exact up to 8 pages, then four per
+ * doubling). Every page of a region is mapped to a span in the page map,
+ * either an object or a run of free pages, and freed runs coalesce with
+ * free neighbours through it. Long free runs are purged with madvise,
+ * and a region that becomes wholly free is given back to the heap.
+ *
+ * Cache coloring:
+ * ===============
+ * Large blocks carved one after another tend to start at the same offset
+ * within a page, so walking several of them together thrashes the same
+ * cache sets. With MM_COLOR=n in the environment (or mm_set_color(n)),
+ * each request of at least n bytes gets COLOR_STEP * c leading bytes of
+ * extra room, with c rotating over NCOLORS, and that room is split off
+ * again as a free block in front of it.
+ *
+ * Cache line ownership:
+ * =====================
+ * A block allocated with mm_malloc_flags(size, MM_NOSHARE), or any block
+ * when MM_NOSHARE is set in the environment, starts on a cache line and
+ * is rounded up to whole lines, so objects handed to different threads
+ * never share a line. A tail too small to split off may leave the block
+ * a little longer, reaching into the line of the next payload, so
+ * mm_usable_size counts only its whole lines. The block keeps
+ * NOSHARE_BIT in its header and footer so that realloc preserves this.
+ *
+ * Threads:
+ * ========
+ * Built with -DMM_THREADS, malloc, free and realloc take one heap lock,
+ * except that blocks of up to PCPU_MAX bytes are freed into and taken
+ * from per-CPU caches without it (mmpcpu.h). Without rseq support the
+ * caches stay empty and everything goes through the lock.
+ *
+ * Heap files:
+ * ===========
+ * With MM_HEAP_FILE=path, memlib maps that file shared as the heap, so a
+ * heap larger than memory pages to the file through the page cache
+ * instead of to swap. Segments map their own parts of the same file, and
+ * MM_HEAP_SIZE=n[K|M|G] raises the brk heap above MAX_HEAP (all of it
+ * within the 4 GB the free list offsets reach). mm_heap_advise passes
+ * sequential or random access hints for a block or the whole heap to
+ * madvise, and mm_heap_sync writes dirty pages back with msync.
+ *
+ * Tags:
+ * =====
+ * mm_malloc_tagged charges a block to one of MM_NTAGS tags. The block
+ * carries TAG_BIT in its header and footer and the tag in the word
+ * before its footer (the block grows by ALIGNMENT only if its padding has
+ * no room for it), and its size is added to the allocating thread's
+ * counters for the tag in the stats slots (mmstats.h). free subtracts it
+ * from the freeing thread's counters; mm_tag_usage sums all slots.
+ * Untagged blocks pay only a bit test in free. Tagged blocks skip slabs,
+ * the page heap, guard sampling and the per-CPU caches, and realloc
+ * always moves them.
+ *
+ * Segments:
+ * =========
+ * The heap starts as one block sequence grown with mem_sbrk. When that
+ * runs out, or always with MM_SEGMENT=n in the environment, it grows by
+ * mapping separate segments of at least n bytes instead (memlib keeps
+ * the segment table). Each segment has its own prologue and epilogue,
+ * and is unmapped once its blocks coalesce into one free block, so a
+ * heap that grew for a burst shrinks back afterwards. The first segment
+ * to become empty is kept as a spare, though, and only a second empty
+ * one is unmapped, so that a segment-sized block allocated and freed in
+ * a loop does not map and unmap a segment every time. Segments are
+ * mapped within 4 GB of the heap start, which keeps free list offsets
+ * in 32 bits.
+ *
+ * Guard pages:
+ * ============
+ * With MM_GUARD_RATE=n in the environment, one in n allocations is served
+ * from a pool of guard-page-flanked slots instead, so that overflows and
+ * uses after free of those blocks fault with a report (see mmguard.h).
+ *
+ * Statistics:
+ * ===========
+ * Heap size, live bytes, free bytes per list and operation counts are kept
+ * in mm_stats through the STAT_xxx macros and published to a shared-memory
+ * page for mm_top when MM_STATS is set (see mmstats.h).
+ * Built with -DMM_PHASES, PHASE_SCOPE() charges the cycles of malloc, free,
+ * realloc and each internal helper to per-phase accumulators (mmphase.h).
  */
 
 #include <assert.h>
@@ -64,9 +230,21 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/mman.h>
 
 #include "mm.h"
 #include "memlib.h"
+#include "mmevent.h"
+#include "mmstats.h"
+#include "mmphase.h"
+#include "mmguard.h"
+#include "mmpagemap.h"
+#include "mmcachesim.h"
+#include "mmcopy.h"
+#ifdef MM_THREADS
+#include <pthread.h>
+#include "mmpcpu.h"
+#endif
 
 /* If you want debugging output, use the following macro.  When you hand
  * in, remove the #define DEBUG line. */
@@ -87,37 +265,127 @@
 #define calloc mm_calloc
 #endif /* def DRIVER */
 
-/* single word (4) or double word (8) alignment */
-#define ALIGNMENT 8
+/* double word (8) or, with -DMM_ALIGN16, quad word (16) alignment */
+#define ALIGNMENT MM_ALIGNMENT
 
 /* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(p) (((size_t)(p) + (ALIGNMENT-1)) & ~0x7)
+#define ALIGN(p) (((size_t)(p) + (ALIGNMENT-1)) & ~(size_t)(ALIGNMENT-1))
 
 
 /* Basic Constants/Macros */
 
+/* With -DMM_THREADS the heap is protected by one lock, and small blocks
+ * are recycled through lock-free per-CPU caches (see mmpcpu.h) */
+#ifdef MM_THREADS
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK() pthread_mutex_lock(&heap_lock)
+#define UNLOCK() pthread_mutex_unlock(&heap_lock)
+#else
+#define LOCK() ((void)0)
+#define UNLOCK() ((void)0)
+#endif
+
 #define WSIZE 4 /* Word and header/footer size (bytes) */
 #define DSIZE 8 /* Double word size (bytes) */
 
 #define CHUNKSIZE (1<<8)
 
-#define MAXLIST 12// number of segregated free list
-#define MINLISTSIZE 24 // this is done to ensure that blocks 
-                       // of size>16 and size<24 do not go 
-                       // into the free list of size 32.  
+/* Exact-size bins: every block size from 16 up to SMALLBIN_MAX (in steps
+ * of ALIGNMENT) has a list of its own. Can be changed with -DSMALLBIN_MAX=n. */
+#ifndef SMALLBIN_MAX
+#define SMALLBIN_MAX 512
+#endif
+#if SMALLBIN_MAX < 2*DSIZE || SMALLBIN_MAX % ALIGNMENT != 0
+#error "SMALLBIN_MAX must be a multiple of ALIGNMENT and at least 16"
+#endif
+#define NSMALLBINS ((SMALLBIN_MAX - 2*DSIZE)/ALIGNMENT + 1) // 16 .. SMALLBIN_MAX
+#define NLARGEBINS 20  // power-of-two size classes above SMALLBIN_MAX
+#define NSIZELISTS (NSMALLBINS + NLARGEBINS) // lists ordered by size
+
+/* Dedicated bins for hot sizes above SMALLBIN_MAX, created at run time
+ * (see hot_sample). They follow the size-ordered lists. */
+#define NHOTBINS 8
+#define HOTMAP_SIZE 64      // direct-mapped size -> hot bin table
+#define HOT_PERIOD 16       // sample one in HOT_PERIOD large requests
+#define HOT_TABLE 16        // sizes tracked by the heavy-hitters table
+#define HOT_EPOCH 256       // samples between count decays
+#define HOT_PROMOTE 24      // count at which a size gets a bin
+#define HOT_RETIRE 4        // count below which a bin is retired
+
+#define NLISTS (NSIZELISTS + NHOTBINS) // number of segregated free lists
+#define LARGE_SHIFT (31 - __builtin_clz(SMALLBIN_MAX))
+#if NLISTS > STATS_NBUCKETS
+#error "SMALLBIN_MAX too large for the stats page"
+#endif
+#if NHOTBINS > STATS_NHOT
+#error "NHOTBINS too large for the stats page"
+#endif
+
+/* One bit per free list, set while the list is non-empty */
+#define BINMAP_WORDS ((NLISTS + 63) / 64)
+
+/* Cache coloring: payloads of requests of at least color_min bytes start
+ * COLOR_STEP * c bytes into their block, with c rotating over NCOLORS */
+#define COLOR_STEP 64
+#define NCOLORS 16
+
+/* Largest request MM_SLAB can route to slab pages: pages of equal-sized
+ * objects without headers, described by a span in the page map
+ * (mmpagemap.h). One class per multiple of ALIGNMENT. */
+#define SLAB_MAX 64
+#define SLAB_NCLASSES (SLAB_MAX / ALIGNMENT)
+
+/* With MM_PAGES=n, requests from n bytes up to PAGES_MAX are served by
+ * the page heap in whole pages. The page heap takes REGION_PAGES pages
+ * from the heap at a time. */
+#define PAGES_MAX (256 * 1024)
+#define PAGES_MAXPAGES (PAGES_MAX >> MM_PAGE_SHIFT)
+#define REGION_PAGES (2 * PAGES_MAXPAGES)
+#define PURGE_PAGES 16      // free spans at least this long are purged
+
+/* mm_malloc_near looks at up to NEAR_PROBES blocks on each side of its
+ * hint, no further than NEAR_RANGE bytes away */
+#define NEAR_PROBES 32
+#define NEAR_RANGE 4096
+
+/* Blocks allocated with MM_NOSHARE own whole cache lines */
+#define LINESIZE 64
+#define NOSHARE_BIT 0x2     // header/footer bit of such blocks
+
+/* Tagged blocks have TAG_BIT in their header and footer and keep their
+ * tag in the word before the footer. Internally the tag travels in the
+ * allocation flags above the MM_xxx bits. */
+#define TAG_BIT 0x4
+#define TAG_SHIFT 8
+#define TAGP(bp) (FTRP(bp) - WSIZE)
+#if MM_NTAGS > STATS_NTAGS
+#error "MM_NTAGS exceeds the tags mmstats.h has room for"
+#endif
+
+#define MINBLOCKSIZE 16 // smallest block
+#define SPLIT_MIN 24    // place splits off only remainders larger than this
 
 #define MAX(x, y) ((x) > (y)? (x) : (y))
+#define MIN(x, y) ((x) < (y)? (x) : (y))
+
+/* Block size for a request of size bytes: the payload plus header and
+ * footer, rounded up to ALIGNMENT */
+#define ADJUST(size) MAX(MINBLOCKSIZE, ALIGN((size) + DSIZE))
 
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc) ((size) | (alloc))
 
- /* Read and write a word at address p */
-#define GET(p) (*(unsigned *)(p))
-#define PUT(p, val) (*(unsigned *)(p) = (intptr_t)(val))
+ /* Read and write a word at address p (through the cache simulator in
+    an MM_CACHESIM build) */
+#define GET(p) (CACHESIM_TOUCH((p), WSIZE), *(unsigned *)(p))
+#define PUT(p, val) (CACHESIM_TOUCH((p), WSIZE), \
+	*(unsigned *)(p) = (intptr_t)(val))
 
 /* Read the size and allocated fields from address p */
 #define GET_SIZE(p) (GET(p) & ~0x7)
 #define GET_ALLOC(p) (GET(p) & 0x1)
+#define GET_NOSHARE(p) (GET(p) & NOSHARE_BIT)
+#define GET_TAGGED(p) (GET(p) & TAG_BIT)
 
 /* Given block ptr bp, compute address of its header and footer */
 #define HDRP(bp) ((char *)(bp) - WSIZE)
@@ -131,9 +399,8 @@
 #define SUCC(bp)   ((char *) ((char*)(bp)))
 #define PRED(bp)   ((char *) ((char*)(bp) + WSIZE))
 
-/* Maximum size of free list of index n */
-#define LIST_MAX_SIZE(n) (unsigned)(16*(1 << n))
-#define LIST_MIN_SIZE(n) (unsigned)(16*(1 << (n-1)))
+/* Address of the head of free list n */
+#define LISTP(n) (freeblocklist + WSIZE*(n))
 
 /* Settings for mm_checkheap */
 #define CHECK         0 /* Kill bit: Set to 0 to disable checking
@@ -144,19 +411,71 @@
 
 /*Help Functions*/
 static void *extend_heap(size_t words);
+static void *grow_heap(size_t size);
+static void *extend_segment(size_t size);
+static void drop_segment(void *bp);
+static int seg_empty(void *bp);
 static void *coalesce(void *bp);
 static void place(void *bp, size_t asize);
 static void *find_fit(size_t asize);
+static void *find_near(size_t asize);
 static void insertnode(void *ptr, size_t size);
-static void *find_valid_block(size_t size, int index);
+static void *find_valid_block(size_t size, int index, unsigned *probes);
 static void deletenode(void *ptr);
+static int listindex(size_t size);
+static int sizeindex(size_t size);
+static int nextlist(int index);
+static int hotlist(size_t asize);
+static void hot_sample(size_t asize);
+static void hot_create(size_t asize);
+static void hot_retire(int hot);
+static void movelist(int from, size_t size);
+static void *guard_malloc(size_t size);
+static void *split_lead(void *bp, size_t shift);
+static void *allocate(size_t size, int flags);
+static void release(void *ptr);
+static void tag_charge(void *bp, int tag, int sign);
+static void *reallocate(void *ptr, size_t size);
+static void move_payload(void *dst, const void *src, size_t n);
+static void resize_block(void *ptr, size_t minsize, size_t asize);
+static void *carve(size_t asize, size_t align, size_t shift);
+static void free_block(void *bp);
+static void *slab_alloc(size_t size);
+static mm_span_t *slab_create(int cls);
+static void slab_free(mm_span_t *sp, void *ptr);
+static void span_link(mm_span_t **head, mm_span_t *sp);
+static void span_unlink(mm_span_t **head, mm_span_t *sp);
+static void *pages_alloc(size_t size);
+static mm_span_t *region_create(void);
+static void pages_free(mm_span_t *sp);
 static void checkblock(void *bp);
 static long checkfreeblocks();
+static long checkblocks(char *ptr);
 
 /*Global variables*/
 char* heap_listp;
 char *freeblocklist;
 char *offset = (char *)0x800000000;
+static unsigned freelists[NLISTS];  // free list heads (heap offsets)
+static unsigned long binmap[BINMAP_WORDS]; // non-empty free lists
+static unsigned hotsize[NHOTBINS];      // block size of each hot bin, or 0
+static unsigned char hotmap[HOTMAP_SIZE]; // hot bin + 1 by size, or 0
+static struct {
+	unsigned size;
+	unsigned count;
+} hottable[HOT_TABLE];                  // sampled sizes (space-saving)
+static int hot_countdown = HOT_PERIOD;  // large requests until next sample
+static int hot_samples;                 // samples in this epoch
+static size_t color_min;                // smallest colored request, 0 = off
+static int color_next;                  // color of the next such request
+static int default_flags;               // MM_xxx flags applied to malloc
+static char *near_hint;                 // mm_malloc_near's hint, or NULL
+static size_t slab_max;                 // largest request for slabs, 0=off
+static mm_span_t *slabs[SLAB_NCLASSES]; // slabs with free objects, by class
+static size_t pages_min;                // smallest request for pages, 0=off
+static mm_span_t *freepages[PAGES_MAXPAGES + 1]; // free spans, by npages
+static size_t seg_min;                  // grow by segments of this size
+static char *spare_seg;                 // block of a kept empty segment
 int line_count; // Running count of operations performed
 int skip = 0;
 #ifdef NEXT_FIT
@@ -171,14 +490,41 @@ static char *rover;           /* Next fit rover */
 int mm_init(void) {
 	int i;
 	char *bp;
-	if((freeblocklist = mem_sbrk(MAXLIST*WSIZE)) == NULL){
-		return -1;
-	} 
+	char *env;
+
+	mm_guard_init();
+	mm_stats_init();
+	mm_copy_init();
+#ifdef MM_THREADS
+	mm_pcpu_init();
+#endif
+	color_min = (env = getenv("MM_COLOR")) != NULL ? strtoul(env, NULL, 0) : 0;
+	color_next = 0;
+	default_flags = getenv("MM_NOSHARE") != NULL ? MM_NOSHARE : 0;
+	slab_max = (env = getenv("MM_SLAB")) != NULL ? strtoul(env, NULL, 0) : 0;
+	slab_max = MIN(slab_max, SLAB_MAX);
+	pages_min = (env = getenv("MM_PAGES")) != NULL ? strtoul(env, NULL, 0) : 0;
+	seg_min = (env = getenv("MM_SEGMENT")) != NULL ? strtoul(env, NULL, 0) : 0;
+	spare_seg = NULL;
+	mm_stats.nbuckets = NLISTS;
+	// The list heads are kept outside the heap, so that having many exact-
+	// size bins costs no heap space
+	freeblocklist = (char *)freelists;
 	// Initialize free block lists
-	for(i=0; i<=MAXLIST; i++)
+	for(i=0; i<NLISTS; i++)
 	{
-		PUT(freeblocklist+WSIZE*i, NULL);
+		PUT(LISTP(i), NULL);
 	}
+	memset(binmap, 0, sizeof(binmap));
+	mm_pagemap_reset();
+	memset(slabs, 0, sizeof(slabs));
+	memset(freepages, 0, sizeof(freepages));
+	memset(hotsize, 0, sizeof(hotsize));
+	memset(hotmap, 0, sizeof(hotmap));
+	memset(hottable, 0, sizeof(hottable));
+	hot_countdown = HOT_PERIOD;
+	hot_samples = 0;
+	memset(mm_stats.hot_size, 0, sizeof(mm_stats.hot_size));
 
 	// Create initial empty heap
 	if((heap_listp = mem_sbrk(4*WSIZE)) == (void *)-1){
@@ -216,39 +562,288 @@ int mm_init(void) {
  * (2) when mm_malloc is unable to find a suitable fit.
  */
 static void *extend_heap(size_t words){
+	PHASE_SCOPE(PH_EXTEND);
 	char *bp;
 	size_t size;
 
-	// allocate even number of words to maintain alignment
-	size = (words % 2)?((words + 1)* WSIZE):(words * WSIZE);
+	// allocate a multiple of ALIGNMENT to maintain alignment
+	size = ALIGN(words * WSIZE);
+	if(seg_min != 0 || (bp = grow_heap(size)) == NULL){
+		return extend_segment(size);
+	}
+	return bp;
+}
+
+/* grow_heap(size)
+ *
+ * Extends the sbrk heap by a free block of size bytes (a multiple of
+ * ALIGNMENT), coalesced with a free block before it. Returns NULL if
+ * mem_sbrk fails.
+ */
+static void *grow_heap(size_t size){
+	char *bp;
+
 	if((long)(bp = mem_sbrk(size)) == -1){
-		return (void *)0;
+		return NULL;
 	}
-	
+
 	// initialize free block header
 	PUT(HDRP(bp), PACK(size,0));// free block header
 	PUT(FTRP(bp), PACK(size,0));// free block foother
 	PUT(HDRP(NEXT_BLKP(bp)), PACK(0,1));// new epilogue header
+	EVENT(EV_EXTEND, 0, bp, size, 0);
+	STAT_ADD(nextend, 1);
+	STAT_ADD(extend_bytes, size);
 	insertnode(bp, size);
 	return coalesce(bp);	
 }
 
+/* extend_segment(size)
+ *
+ * Maps a new heap segment with room for a free block of at least size
+ * bytes (and at least seg_min bytes in all) and returns that block. The
+ * segment has its own prologue and epilogue, so its blocks never
+ * coalesce with blocks outside it.
+ */
+static void *extend_segment(size_t size){
+	size_t segsize = MAX(size + 4*WSIZE, seg_min);
+	char *bp;
+
+	segsize = (segsize + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+	if((bp = mem_map_segment(segsize)) == NULL){
+		return NULL;
+	}
+	PUT(bp, 0);			   // Alignment padding
+	PUT(bp+(1*WSIZE), PACK(DSIZE,1));  // Prologue header
+	PUT(bp+(2*WSIZE), PACK(DSIZE,1));  // Prologue footer
+	bp += 4*WSIZE;
+	size = segsize - 4*WSIZE;
+	PUT(HDRP(bp), PACK(size,0));
+	PUT(FTRP(bp), PACK(size,0));
+	PUT(HDRP(NEXT_BLKP(bp)), PACK(0,1)); // Epilogue header
+	EVENT(EV_EXTEND, 1, bp, size, 0);
+	STAT_ADD(nextend, 1);
+	STAT_ADD(extend_bytes, size);
+	insertnode(bp, size);
+	return bp;
+}
+
+/* drop_segment(bp)
+ *
+ * Unmaps the segment whose only block is free block bp.
+ */
+static void drop_segment(void *bp){
+	deletenode(bp);
+	EVENT(EV_EXTEND, 2, bp, GET_SIZE(HDRP(bp)), 0);
+	STAT_ADD(npurge, 1);
+	STAT_ADD(purge_bytes, GET_SIZE(HDRP(bp)) + 4*WSIZE);
+	mem_unmap_segment((char *)bp - 4*WSIZE);
+}
+
+/* sizeindex(size)
+ *
+ * Returns the size-ordered free list for blocks of the given size.
+ * list[0] .. list[NSMALLBINS-1] hold exactly 16, 16 + ALIGNMENT, ...
+ * SMALLBIN_MAX bytes
+ * list[NSMALLBINS] holds SMALLBIN_MAX+1 up to the next power of two,
+ * and each following list the next power of two, the last one
+ * everything above.
+ */
+static inline int sizeindex(size_t size){
+	int index;
+
+	if(size <= SMALLBIN_MAX){
+		return (size - 2*DSIZE)/ALIGNMENT;
+	}
+	index = NSMALLBINS + (63 - __builtin_clzl(size - 1)) - LARGE_SHIFT;
+	return (index < NSIZELISTS) ? index : NSIZELISTS - 1;
+}
+
+/* listindex(size)
+ *
+ * Returns the free list a block of the given size belongs to: its hot
+ * bin if the size currently has one, else its size-ordered list.
+ */
+static inline int listindex(size_t size){
+	int hot;
+
+	if(size > SMALLBIN_MAX){
+		hot = hotmap[(size/ALIGNMENT) % HOTMAP_SIZE];
+		if(hot != 0 && hotsize[hot-1] == size){
+			return NSIZELISTS + hot - 1;
+		}
+	}
+	return sizeindex(size);
+}
+
+/* nextlist(index)
+ *
+ * Returns the first non-empty size-ordered free list at or after index,
+ * or -1 if there is none, using the bitmap of non-empty lists.
+ * Hot bins are not ordered by size and are never returned; find_fit
+ * falls back to them through hotlist.
+ */
+static inline int nextlist(int index){
+	int word = index / 64;
+	unsigned long bits;
+
+	if(word >= BINMAP_WORDS){
+		return -1;
+	}
+	bits = binmap[word] & (~0UL << (index % 64));
+	while(bits == 0){
+		if(++word == BINMAP_WORDS){
+			return -1;
+		}
+		bits = binmap[word];
+	}
+	index = word*64 + __builtin_ctzl(bits);
+	return (index < NSIZELISTS) ? index : -1;
+}
+
+/* hot_sample(asize)
+ *
+ * Called for one in HOT_PERIOD requests above SMALLBIN_MAX. Counts the
+ * adjusted size in a small space-saving heavy-hitters table: a size
+ * already in the table has its count bumped, otherwise it replaces the
+ * entry with the lowest count and inherits that count. A size whose count
+ * reaches HOT_PROMOTE gets a dedicated bin. Every HOT_EPOCH samples all
+ * counts are halved and bins whose size has cooled below HOT_RETIRE are
+ * retired.
+ */
+static void hot_sample(size_t asize){
+	int i, min = 0, hot;
+
+	hot_countdown = HOT_PERIOD;
+	for(i = 0; i < HOT_TABLE; i++){
+		if(hottable[i].size == asize){
+			break;
+		}
+		if(hottable[i].count < hottable[min].count){
+			min = i;
+		}
+	}
+	if(i == HOT_TABLE){
+		i = min;
+		hottable[i].size = asize;
+	}
+	hottable[i].count++;
+	if(hottable[i].count >= HOT_PROMOTE && listindex(asize) < NSIZELISTS){
+		hot_create(asize);
+	}
+
+	if(++hot_samples < HOT_EPOCH){
+		return;
+	}
+	hot_samples = 0;
+	for(i = 0; i < HOT_TABLE; i++){
+		hottable[i].count /= 2;
+	}
+	for(hot = 0; hot < NHOTBINS; hot++){
+		if(hotsize[hot] == 0){
+			continue;
+		}
+		for(i = 0; i < HOT_TABLE; i++){
+			if(hottable[i].size == hotsize[hot]){
+				break;
+			}
+		}
+		if(i == HOT_TABLE || hottable[i].count < HOT_RETIRE){
+			hot_retire(hot);
+		}
+	}
+}
+
+/* hot_create(asize)
+ *
+ * Gives blocks of exactly asize bytes a dedicated bin, if a bin and its
+ * hotmap slot are free, and moves the free blocks of that size over from
+ * the size-ordered list.
+ */
+static void hot_create(size_t asize){
+	int hot, slot = (asize/ALIGNMENT) % HOTMAP_SIZE;
+
+	if(hotmap[slot] != 0){
+		return;
+	}
+	for(hot = 0; hot < NHOTBINS; hot++){
+		if(hotsize[hot] == 0){
+			break;
+		}
+	}
+	if(hot == NHOTBINS){
+		return;
+	}
+	hotsize[hot] = asize;
+	hotmap[slot] = hot + 1;
+	mm_stats.hot_size[hot] = asize;
+	movelist(sizeindex(asize), asize);
+}
+
+/* hot_retire(hot)
+ *
+ * Returns the blocks of a cooled hot bin to their size-ordered list and
+ * frees the bin.
+ */
+static void hot_retire(int hot){
+	size_t asize = hotsize[hot];
+
+	hotmap[(asize/ALIGNMENT) % HOTMAP_SIZE] = 0;
+	hotsize[hot] = 0;
+	mm_stats.hot_size[hot] = 0;
+	movelist(NSIZELISTS + hot, asize);
+}
+
+/* movelist(from, size)
+ *
+ * Moves every free block of exactly size bytes from list "from" to the
+ * list listindex now gives for that size. A block's list is derived from
+ * its size, so each block is unlinked from the old list by hand and
+ * reinserted under the new mapping.
+ */
+static void movelist(int from, size_t size){
+	unsigned blk_addr = GET(LISTP(from));
+	unsigned next;
+	char *bp, *pred, *succ;
+
+	while(blk_addr != 0){
+		bp = offset + blk_addr;
+		next = GET(SUCC(bp));
+		if(GET_SIZE(HDRP(bp)) == size){
+			pred = offset + GET(PRED(bp));
+			succ = offset + next;
+			if(GET(PRED(bp)) != 0){
+				PUT(SUCC(pred), next ? succ : NULL);
+			} else {
+				PUT(LISTP(from), next ? succ : NULL);
+			}
+			if(next != 0){
+				PUT(PRED(succ), GET(PRED(bp)) ? pred : NULL);
+			}
+			STAT_SUB(bucket_free[from], size);
+			insertnode(bp, size);
+		}
+		blk_addr = next;
+	}
+	if(GET(LISTP(from)) == 0){
+		binmap[from / 64] &= ~(1UL << (from % 64));
+	}
+}
+
 /**
- * Inserts the free block into appropriate index in free list
- * FreelIst[0] size <=16
- * list[1] = 2^4 - 2^5
- * and so on 2^n to 2^n+1
+ * Inserts the free block at the head of its free list (see listindex)
+ * and marks the list non-empty in the bitmap.
  */
 static void insertnode(void *bp, size_t size){
-	int index=0;
+	PHASE_SCOPE(PH_INSERT);
+	int index = listindex(size);
 	void *freeblockhead = NULL; 
     char *header;
 
-	while((index < MAXLIST) && (size > MINLISTSIZE)){
-		size >>=1;
-		index++;
-	}
-	freeblockhead = freeblocklist + (WSIZE * index);
+	EVENT(EV_INSERT, index, bp, size, 0);
+	STAT_ADD(bucket_free[index], size);
+	binmap[index / 64] |= 1UL << (index % 64);
+	freeblockhead = LISTP(index);
 	header = offset + GET(freeblockhead);
 
 	if(GET(freeblockhead) != 0){
@@ -283,6 +878,7 @@ static void insertnode(void *bp, size_t size){
  *    into one. 
  */
 static void *coalesce(void *bp){
+	PHASE_SCOPE(PH_COALESCE);
 	
     size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
 	size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
@@ -290,6 +886,7 @@ static void *coalesce(void *bp){
    
     //1st case
 	if(prev_alloc && next_alloc){
+		EVENT(EV_COALESCE, 1, bp, size, 0);
 		return bp;
 	}
 
@@ -300,6 +897,7 @@ static void *coalesce(void *bp){
 		deletenode(NEXT_BLKP(bp));
 		PUT(HDRP(bp), PACK(size,0));
 		PUT(FTRP(bp), PACK(size,0));
+		EVENT(EV_COALESCE, 2, bp, size, 0);
 	} else if(!prev_alloc && next_alloc){
         // 3rd Case
         size += GET_SIZE(HDRP(PREV_BLKP(bp)));
@@ -308,6 +906,7 @@ static void *coalesce(void *bp){
 		PUT(HDRP(PREV_BLKP(bp)), PACK(size,0));
 		PUT(FTRP(bp), PACK(size,0));
         bp = PREV_BLKP(bp);
+		EVENT(EV_COALESCE, 3, bp, size, 0);
 	} else {
         // 4th Case
 		size += GET_SIZE(HDRP(PREV_BLKP(bp)))+
@@ -318,6 +917,7 @@ static void *coalesce(void *bp){
 		PUT(HDRP(PREV_BLKP(bp)), PACK(size,0));
 		PUT(FTRP(NEXT_BLKP(bp)), PACK(size,0));
 		bp = PREV_BLKP(bp);
+		EVENT(EV_COALESCE, 4, bp, size, 0);
 	}
 
 #ifdef NEXT_FIT
@@ -337,15 +937,14 @@ static void *coalesce(void *bp){
  *
  */
 static void deletenode(void *bp){
-	int index = 0;
+	PHASE_SCOPE(PH_DELETE);
 	size_t size = GET_SIZE(HDRP(bp));
+	int index = listindex(size);
  	char *succ = offset + GET(SUCC(bp));
 	char *pred = offset + GET(PRED(bp));	
-	//get the index where bp is in list
-	while((index < MAXLIST) && (size > MINLISTSIZE)){
-		size>>=1;
-		index++;
-	}
+
+	EVENT(EV_DELETE, index, bp, size, 0);
+	STAT_SUB(bucket_free[index], size);
 	if(GET(PRED(bp)) != 0) {
 		if(GET(SUCC(bp)) == 0) {
 			PUT(SUCC(pred), NULL);
@@ -355,10 +954,11 @@ static void deletenode(void *bp){
 		}
 	} else {
 		if(GET(SUCC(bp)) == 0) {
-			PUT(freeblocklist+index*WSIZE, NULL);	
+			PUT(LISTP(index), NULL);	
+			binmap[index / 64] &= ~(1UL << (index % 64));
 		} else {
 			PUT(PRED(succ), NULL);
-			PUT(freeblocklist+WSIZE*index, succ);
+			PUT(LISTP(index), succ);
 		}
 	}
 }
@@ -373,86 +973,636 @@ static void deletenode(void *bp){
  *
  */
 void *malloc (size_t size) {
+	void *bp;
+
+#ifdef MM_THREADS
+	// Cache hits are only counted in the thread's own stats slot
+	size_t asize = ADJUST(size);
+	if(asize <= PCPU_MAX && size != 0 && default_flags == 0 &&
+			(bp = mm_pcpu_pop(PCPU_CLASS(asize))) != NULL){
+		STAT_THREAD_ADD(nmalloc, 1);
+		STAT_THREAD_ADD(malloc_bytes, size);
+		return bp;
+	}
+#endif
+	LOCK();
+	bp = allocate(size, default_flags);
+	UNLOCK();
+	return bp;
+}
+
+/*
+ * mm_malloc_flags - malloc with MM_xxx flags (see mm.h)
+ */
+void *mm_malloc_flags(size_t size, int flags){
+	void *bp;
+
+	LOCK();
+	bp = allocate(size, flags | default_flags);
+	UNLOCK();
+	return bp;
+}
+
+/*
+ * mm_malloc_near - malloc preferring a free block close to block hint
+ */
+void *mm_malloc_near(size_t size, void *hint){
+	void *bp;
+
+	LOCK();
+	// only a heap block has neighbours to walk to
+	if(hint != NULL && !GUARD_OWNS(hint) && mm_pagemap_get(hint) == NULL){
+		near_hint = hint;
+	}
+	bp = allocate(size, default_flags);
+	near_hint = NULL;
+	UNLOCK();
+	return bp;
+}
+
+/* allocate(size, flags)
+ *
+ * The body of malloc. With MM_NOSHARE the block is rounded up to whole
+ * cache lines and its payload starts on a line boundary, so no other
+ * block's payload shares a line with it.
+ */
+static inline void *allocate(size_t size, int flags){
+	PHASE_SCOPE(PH_MALLOC);
 	size_t asize;      /* Adjusted block size */
-	size_t extendsize; /* Amount to extend heap if no fit */
+	size_t shift = 0;  /* Leading bytes to split off for cache coloring */
+	int tag = flags >> TAG_SHIFT;
 	char *bp;
 	if (size == 0) {
 		return NULL;
 	}
+	if (tag == 0 && GUARD_SAMPLE() && (bp = guard_malloc(size)) != NULL) {
+		return bp;
+	}
 
 	/* Adjust block size to include overhead and alignment reqs. */
-	if (size <=  DSIZE) {
-		asize= 2*DSIZE;
+	asize = ADJUST(size);
+	EVENT(EV_MALLOC, 0, NULL, size, asize);
+	if(asize > SMALLBIN_MAX && --hot_countdown <= 0){
+		hot_sample(asize);
+	}
+	STAT_ADD(nmalloc, 1);
+	STAT_THREAD_ADD(nmalloc, 1);
+	STAT_THREAD_ADD(malloc_bytes, size);
+	STAT_TICK();
+
+	if(tag != 0){
+		if(asize - DSIZE - size < WSIZE){
+			asize += ALIGNMENT; // room for the tag word
+		}
+	} else if(!(flags & MM_NOSHARE)){
+		if(size <= slab_max){
+			return slab_alloc(size);
+		}
+		if(pages_min != 0 && size >= pages_min && size <= PAGES_MAX){
+			return pages_alloc(size);
+		}
+	}
+	if(flags & MM_NOSHARE){
+		asize = (asize + LINESIZE - 1) & ~(size_t)(LINESIZE - 1);
+		if((bp = carve(asize, LINESIZE, 0)) != NULL){
+			PUT(HDRP(bp), GET(HDRP(bp)) | NOSHARE_BIT);
+			PUT(FTRP(bp), GET(FTRP(bp)) | NOSHARE_BIT);
+		}
 	} else {
-		// round up to the nearest multiple of 8
-		asize = DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE);
+		if(color_min != 0 && size >= color_min){
+			shift = COLOR_STEP * color_next;
+			color_next = (color_next + 1) % NCOLORS;
+		}
+		bp = carve(asize, 0, shift);
 	}
-	
-	/* Search the free list for a fit */
-	if ((bp = find_fit(asize)) != NULL) {
-		place(bp, asize);
-		return bp;
+	if(tag != 0 && bp != NULL){
+		PUT(HDRP(bp), GET(HDRP(bp)) | TAG_BIT);
+		PUT(FTRP(bp), GET(FTRP(bp)) | TAG_BIT);
+		PUT(TAGP(bp), tag);
+		tag_charge(bp, tag, 1);
+	}
+	return bp;
+}
+
+/* tag_charge(bp, tag, sign)
+ *
+ * Adds (sign 1) or subtracts (sign -1) block bp to/from the calling
+ * thread's counters for tag.
+ */
+static void tag_charge(void *bp, int tag, int sign){
+	mm_stats_thread_t *th = STAT_THREAD();
+
+	th->tag_bytes[tag] += sign * (int64_t)GET_SIZE(HDRP(bp));
+	th->tag_blocks[tag] += sign;
+}
+
+/*
+ * mm_malloc_tagged - malloc charged to tag
+ */
+void *mm_malloc_tagged(size_t size, int tag){
+	void *bp;
+
+	if(tag <= 0 || tag >= MM_NTAGS){
+		return malloc(size);
+	}
+	LOCK();
+	bp = allocate(size, (tag << TAG_SHIFT) | default_flags);
+	UNLOCK();
+	return bp;
+}
+
+/*
+ * mm_tag_usage - sum the per-thread counters of tag
+ */
+void mm_tag_usage(int tag, size_t *bytes, size_t *blocks){
+	int64_t b = 0, n = 0;
+	int i;
+
+	if(tag > 0 && tag < MM_NTAGS){
+		LOCK();
+		for(i = 0; i < STATS_NTHREADS; i++){
+			b += mm_stats.thread[i].tag_bytes[tag];
+			n += mm_stats.thread[i].tag_blocks[tag];
+		}
+		UNLOCK();
 	}
+	*bytes = b;
+	*blocks = n;
+}
 
-	/* No fit found. Get more memory and place the block */
-	extendsize = MAX(asize,CHUNKSIZE);
-	if ((bp = extend_heap(extendsize/WSIZE)) == NULL){
-		return NULL;
+/* carve(asize, align, shift)
+ *
+ * Finds (or gets from the system) room for a block of asize bytes and
+ * places the block there. With a non-zero align (a power of two) the
+ * block pointer is aligned to it; otherwise shift bytes are split off in
+ * front of the block. Either way the leading piece stays free.
+ */
+static void *carve(size_t asize, size_t align, size_t shift){
+	// a non-zero aligning shift must leave a whole free block in front,
+	// so it is at most align + DSIZE
+	size_t slack = align != 0 ? align + DSIZE : shift;
+	size_t extendsize; /* Amount to extend heap if no fit */
+	char *bp;
+
+	/* Search the free list for a fit, next to the hint if there is one */
+	if ((near_hint == NULL || (bp = find_near(asize + slack)) == NULL) &&
+			(bp = find_fit(asize + slack)) == NULL) {
+		/* No fit found. Get more memory */
+		extendsize = MAX(asize + slack,CHUNKSIZE);
+		if ((bp = extend_heap(extendsize/WSIZE)) == NULL){
+			return NULL;
+		}
+	}
+
+	if(align != 0){
+		shift = -(size_t)bp & (align - 1);
+		if(shift != 0 && shift < MINBLOCKSIZE){
+			shift += align;
+		}
+	}
+	if(shift != 0){
+		bp = split_lead(bp, shift);
 	}
 	place(bp, asize);
-        return bp;
+	return bp;
+}
+
+/* slab_alloc(size)
+ *
+ * Takes the lowest free object of the first slab of size's class that
+ * has one, creating a slab if there is none.
+ */
+static void *slab_alloc(size_t size){
+	int cls = (size - 1) / ALIGNMENT;
+	mm_span_t *sp = slabs[cls];
+	int w, i;
+
+	if(sp == NULL && (sp = slab_create(cls)) == NULL){
+		return NULL;
+	}
+	for(w = 0; sp->freemap[w] == 0; w++)
+		;
+	i = __builtin_ctzl(sp->freemap[w]);
+	sp->freemap[w] &= sp->freemap[w] - 1;
+	if(--sp->nfree == 0){
+		span_unlink(&slabs[cls], sp);
+	}
+	return sp->start + (size_t)(64 * w + i) * sp->size;
+}
+
+/* slab_create(cls)
+ *
+ * Carves a page-aligned block whose payload is exactly one page, and
+ * maps that page to a new slab span of class cls with every object free.
+ */
+static mm_span_t *slab_create(int cls){
+	mm_span_t *sp;
+	char *page;
+	int i;
+
+	if((sp = mm_span_new()) == NULL){
+		return NULL;
+	}
+	if((page = carve(ADJUST(MM_PAGE_SIZE), MM_PAGE_SIZE, 0)) == NULL){
+		mm_span_delete(sp);
+		return NULL;
+	}
+	if(mm_pagemap_set(page, 1, sp) < 0){
+		free_block(page);
+		mm_span_delete(sp);
+		return NULL;
+	}
+	sp->kind = SPAN_SLAB;
+	sp->cls = cls;
+	sp->size = (cls + 1) * ALIGNMENT;
+	sp->nobjs = MM_PAGE_SIZE / sp->size;
+	sp->nfree = sp->nobjs;
+	sp->owner = 0; // there is a single heap
+	sp->npages = 1;
+	sp->start = page;
+	for(i = 0; i < sp->nobjs / 64; i++){
+		sp->freemap[i] = ~0UL;
+	}
+	if(sp->nobjs % 64 != 0){
+		sp->freemap[i] = (1UL << (sp->nobjs % 64)) - 1;
+	}
+	span_link(&slabs[cls], sp);
+	return sp;
+}
+
+/* slab_free(sp, ptr)
+ *
+ * Marks ptr free in its slab. A slab that becomes empty gives its page
+ * back to the heap, unless it is the only one of its class with free
+ * objects. Freeing an object that is already free, or a pointer that is
+ * not the start of an object, is reported and aborts.
+ */
+static void slab_free(mm_span_t *sp, void *ptr){
+	size_t i = (size_t)((char *)ptr - sp->start) / sp->size;
+
+	if((size_t)((char *)ptr - sp->start) % sp->size != 0 ||
+			(sp->freemap[i / 64] & (1UL << (i % 64)))){
+		fprintf(stderr, "mm_free: %s of %p in a slab of %u-byte objects\n",
+			(size_t)((char *)ptr - sp->start) % sp->size != 0 ?
+			"invalid free" : "double free", ptr, (unsigned)sp->size);
+		abort();
+	}
+	sp->freemap[i / 64] |= 1UL << (i % 64);
+	if(++sp->nfree == 1){
+		span_link(&slabs[sp->cls], sp);
+	} else if(sp->nfree == sp->nobjs && (sp->next != NULL || 
+			sp->prev != NULL)){
+		span_unlink(&slabs[sp->cls], sp);
+		mm_pagemap_set(sp->start, 1, NULL);
+		free_block(sp->start);
+		mm_span_delete(sp);
+	}
+}
+
+/* pages_class(npages)
+ *
+ * Rounds a page count up to the page heap's class grid: every count up
+ * to 8 pages, then four classes per doubling.
+ */
+static size_t pages_class(size_t npages){
+	size_t step;
+
+	if(npages <= 8){
+		return npages;
+	}
+	step = 1UL << (61 - __builtin_clzl(npages));
+	return (npages + step - 1) & ~(step - 1);
+}
+
+/* Free list of the page heap for spans of npages pages */
+#define PAGES_LIST(npages) ((npages) <= PAGES_MAXPAGES ? (npages) : 0)
+
+/* pages_alloc(size)
+ *
+ * Takes a run of pages for a medium object of size bytes from the
+ * smallest free span that holds it (creating a region if none does),
+ * and leaves the rest of that span free.
+ */
+static void *pages_alloc(size_t size){
+	size_t n = pages_class((size + MM_PAGE_SIZE - 1) >> MM_PAGE_SHIFT);
+	mm_span_t *sp = NULL, *rest = NULL;
+	size_t i;
+
+	for(i = n; i <= PAGES_MAXPAGES && (sp = freepages[i]) == NULL; i++)
+		;
+	if(sp == NULL){
+		for(sp = freepages[0]; sp != NULL && sp->npages < n; sp = sp->next)
+			;
+	}
+	if(sp == NULL && (sp = region_create()) == NULL){
+		return NULL;
+	}
+	if(sp->npages > n && (rest = mm_span_new()) == NULL){
+		return NULL;
+	}
+	span_unlink(&freepages[PAGES_LIST(sp->npages)], sp);
+	if(rest != NULL){
+		rest->kind = SPAN_FREE;
+		rest->region = sp->region;
+		rest->start = sp->start + (n << MM_PAGE_SHIFT);
+		rest->npages = sp->npages - n;
+		mm_pagemap_set(rest->start, rest->npages, rest);
+		span_link(&freepages[PAGES_LIST(rest->npages)], rest);
+		sp->npages = n;
+	}
+	sp->kind = SPAN_PAGES;
+	return sp->start;
+}
+
+/* region_create()
+ *
+ * Carves a page-aligned block of REGION_PAGES pages out of the heap for
+ * the page heap and returns the free span covering it.
+ */
+static mm_span_t *region_create(void){
+	mm_span_t *rg, *sp = NULL;
+	char *start = NULL;
+
+	if((rg = mm_span_new()) == NULL || (sp = mm_span_new()) == NULL ||
+			(start = carve(ADJUST(REGION_PAGES << MM_PAGE_SHIFT),
+				MM_PAGE_SIZE, 0)) == NULL ||
+			mm_pagemap_set(start, REGION_PAGES, sp) < 0){
+		if(start != NULL){
+			free_block(start);
+		}
+		if(sp != NULL){
+			mm_span_delete(sp);
+		}
+		if(rg != NULL){
+			mm_span_delete(rg);
+		}
+		return NULL;
+	}
+	rg->kind = SPAN_REGION;
+	rg->start = start;
+	rg->npages = REGION_PAGES;
+	sp->kind = SPAN_FREE;
+	sp->region = rg;
+	sp->start = start;
+	sp->npages = REGION_PAGES;
+	span_link(&freepages[PAGES_LIST(sp->npages)], sp);
+	return sp;
+}
+
+/* pages_free(sp)
+ *
+ * Frees the pages of medium object span sp, coalescing them with free
+ * neighbours in the same region. A region that becomes wholly free goes
+ * back to the heap; other large free spans are purged, so that their
+ * memory is returned to the system while they wait for reuse.
+ */
+static void pages_free(mm_span_t *sp){
+	mm_span_t *rg = sp->region, *nb;
+	char *end;
+
+	sp->kind = SPAN_FREE;
+	if(sp->start != rg->start &&
+			(nb = mm_pagemap_get(sp->start - 1))->kind == SPAN_FREE){
+		span_unlink(&freepages[PAGES_LIST(nb->npages)], nb);
+		nb->npages += sp->npages;
+		mm_span_delete(sp);
+		sp = nb;
+	}
+	end = sp->start + (sp->npages << MM_PAGE_SHIFT);
+	if(end != rg->start + (rg->npages << MM_PAGE_SHIFT) &&
+			(nb = mm_pagemap_get(end))->kind == SPAN_FREE){
+		span_unlink(&freepages[PAGES_LIST(nb->npages)], nb);
+		sp->npages += nb->npages;
+		mm_span_delete(nb);
+	}
+
+	if(sp->npages == rg->npages){
+		mm_pagemap_set(rg->start, rg->npages, NULL);
+		free_block(rg->start);
+		mm_span_delete(sp);
+		mm_span_delete(rg);
+		return;
+	}
+	mm_pagemap_set(sp->start, sp->npages, sp);
+	if(sp->npages >= PURGE_PAGES){
+		madvise(sp->start, sp->npages << MM_PAGE_SHIFT, MADV_DONTNEED);
+		STAT_ADD(npurge, 1);
+		STAT_ADD(purge_bytes, sp->npages << MM_PAGE_SHIFT);
+	}
+	span_link(&freepages[PAGES_LIST(sp->npages)], sp);
+}
+
+/* span_link(head, sp), span_unlink(head, sp)
+ *
+ * Add or remove sp to/from the span list at head.
+ */
+static void span_link(mm_span_t **head, mm_span_t *sp){
+	sp->prev = NULL;
+	sp->next = *head;
+	if(sp->next != NULL){
+		sp->next->prev = sp;
+	}
+	*head = sp;
+}
+
+static void span_unlink(mm_span_t **head, mm_span_t *sp){
+	if(sp->prev != NULL){
+		sp->prev->next = sp->next;
+	} else {
+		*head = sp->next;
+	}
+	if(sp->next != NULL){
+		sp->next->prev = sp->prev;
+	}
+	sp->next = sp->prev = NULL;
+}
+
+/* split_lead(bp, shift)
+ *
+ * Splits the first shift bytes off free block bp and returns the free
+ * block that follows them, so that a block placed there starts at a
+ * different offset than bp (for cache coloring or line alignment). The
+ * leading piece stays free.
+ */
+static void *split_lead(void *bp, size_t shift){
+	size_t size = GET_SIZE(HDRP(bp));
+
+	deletenode(bp);
+	EVENT(EV_SPLIT, 1, bp, shift, size - shift);
+	PUT(HDRP(bp), PACK(shift, 0));
+	PUT(FTRP(bp), PACK(shift, 0));
+	insertnode(bp, shift);
+	bp = NEXT_BLKP(bp);
+	PUT(HDRP(bp), PACK(size - shift, 0));
+	PUT(FTRP(bp), PACK(size - shift, 0));
+	insertnode(bp, size - shift);
+	return bp;
+}
+
+/*
+ * mm_set_color - color requests of at least min bytes (0 turns it off)
+ */
+void mm_set_color(size_t min){
+	color_min = min;
+	color_next = 0;
+}
+
+/* guard_malloc(size)
+ *
+ * Serves a sampled allocation from the guard-page pool (see mmguard.h).
+ * The pool itself is an ordinary allocated block, taken from the heap
+ * the first time an allocation is sampled. If it cannot be protected,
+ * it is freed again and sampling stays off until the next mm_init.
+ */
+static void *guard_malloc(size_t size){
+	void *pool;
+
+	if(mm_guard_lo == NULL){
+		if((pool = carve(ADJUST(mm_guard_poolsize()), 0, 0)) == NULL){
+			return NULL;
+		}
+		if(mm_guard_attach(pool, mm_guard_poolsize()) < 0){
+			free_block(pool);
+			return NULL;
+		}
+	}
+	return mm_guard_malloc(size);
 }
 
 /* find_fit(size)
  *
- * Finds the free block by first searching the list of free blocks of 
- * appropriate size and and then allocates the free block from that list
+ * Finds a free block of at least size bytes. Every block in an exact-size
+ * bin, and every block in any list above the requested size's own list,
+ * is large enough, so those are taken from the head of the list without
+ * probing. Only the requested size's own power-of-two list is searched
+ * first fit. The bitmap of non-empty lists gives the next list to try.
  *
  * Input: Size of block requested
  * Return value: Pointer to allocated block
  */
-static void *find_fit(size_t size){
+static void *find_fit(size_t asize){
+	PHASE_SCOPE(PH_FIND_FIT);
 	void *bp = NULL;
-	size_t asize = size;
-	int index = 0;
-    // Search for the free blocks list of appropriate size
-	while((index < MAXLIST) && (size > MINLISTSIZE)){
-		index++;
-		size>>=1;
+	int index = listindex(asize);
+	unsigned probes = 0;
+
+	if(index >= NSIZELISTS){
+		// hot bin: any block in it is exactly asize
+		if(GET(LISTP(index)) != 0){
+			bp = offset + GET(LISTP(index));
+			EVENT(EV_SEARCH, index, bp, asize, 1);
+			return bp;
+		}
+		index = sizeindex(asize);
 	}
-	while(bp == NULL && index <= MAXLIST){
-		bp = find_valid_block(asize, index);
+	if(index >= NSMALLBINS){
+		bp = find_valid_block(asize, index, &probes);
 		index++;
 	}
+	if(bp == NULL && (index = nextlist(index)) >= 0){
+		bp = offset + GET(LISTP(index));
+		probes++;
+	}
+	if(bp == NULL && (index = hotlist(asize)) >= 0){
+		bp = offset + GET(LISTP(index));
+		probes++;
+	}
+	EVENT(EV_SEARCH, index, bp, asize, probes);
 	return bp;
 }
 
+/* hotlist(asize)
+ *
+ * Returns the non-empty hot bin of the smallest size of at least asize,
+ * or -1 if there is none. Called when no size-ordered list has a fit, so
+ * that free blocks of a hot size still serve other requests before the
+ * heap is extended.
+ */
+static int hotlist(size_t asize){
+	int hot, best = -1;
+
+	for(hot = 0; hot < NHOTBINS; hot++){
+		if(hotsize[hot] >= asize && GET(LISTP(NSIZELISTS + hot)) != 0 &&
+				(best < 0 || hotsize[hot] < hotsize[best])){
+			best = hot;
+		}
+	}
+	return best < 0 ? -1 : NSIZELISTS + best;
+}
+
 /* find_valid_block(size, index)
  *
- * Finds the block in the corresponding free list.
+ * Finds the smallest block of at least size bytes in the corresponding
+ * free list, stopping at the first exact fit.
  *
  * Input: 1) Size of the block requested
  *        2) Index of the free blocks list in the free 
  *           lists array
+ *        3) Running count of blocks probed, for event tracing
  *
  * Return Value: Pointer to allocated block 
  */
-static void *find_valid_block(size_t asize, int index){
-  	char *bp = NULL;
+static void *find_valid_block(size_t asize, int index, unsigned *probes){
+  	char *bp = NULL, *best = NULL;
+	size_t size, bestsize = 0;
 	unsigned int blk_addr;
-	blk_addr = GET(freeblocklist + (WSIZE * index));
+	blk_addr = GET(LISTP(index));
 	while(blk_addr !=0)
 	{
 		bp = offset + blk_addr;
-		if(asize <= GET_SIZE(HDRP(bp))){
-            return bp;
+		(*probes)++;
+		size = GET_SIZE(HDRP(bp));
+		if(asize <= size && (best == NULL || size < bestsize)){
+			best = bp;
+			bestsize = size;
+			if(size == asize){
+				break;
+			}
 		}
 		blk_addr = GET(SUCC(bp));
 	}
-	return NULL;
+	return best;
 }
 
 
+/* find_near(asize)
+ *
+ * Looks for a free block of at least asize bytes among the heap blocks
+ * around near_hint: up to NEAR_PROBES blocks after it, then as many
+ * before it, stopping NEAR_RANGE bytes away and at the ends of the heap
+ * or segment. Returns the first one found, or NULL.
+ */
+static void *find_near(size_t asize){
+	PHASE_SCOPE(PH_FIND_FIT);
+	char *bp;
+	unsigned probes = 0;
+
+	for(bp = NEXT_BLKP(near_hint); probes < NEAR_PROBES &&
+			bp < near_hint + NEAR_RANGE && GET_SIZE(HDRP(bp)) != 0;
+			bp = NEXT_BLKP(bp)){
+		probes++;
+		if(!GET_ALLOC(HDRP(bp)) && GET_SIZE(HDRP(bp)) >= asize){
+			EVENT(EV_SEARCH, 255, bp, asize, probes);
+			return bp;
+		}
+	}
+	// the footer before the first block is the prologue's
+	for(bp = near_hint; probes < 2*NEAR_PROBES &&
+			GET_SIZE(bp - DSIZE) != DSIZE; ){
+		bp = PREV_BLKP(bp);
+		if(bp < near_hint - NEAR_RANGE){
+			break;
+		}
+		probes++;
+		if(!GET_ALLOC(HDRP(bp)) && GET_SIZE(HDRP(bp)) >= asize){
+			EVENT(EV_SEARCH, 255, bp, asize, probes);
+			return bp;
+		}
+	}
+	EVENT(EV_SEARCH, 255, NULL, asize, probes);
+	return NULL;
+}
+
 /*
  * place(bp, size)
  *
@@ -466,6 +1616,7 @@ static void *find_valid_block(size_t asize, int index){
  * Return value: Pointer to the block allocated 
  */
 static void place(void *bp, size_t asize){
+	PHASE_SCOPE(PH_PLACE);
 
 	size_t csize=GET_SIZE(HDRP(bp));// get block size
     size_t remainder = csize - asize;	
@@ -473,9 +1624,11 @@ static void place(void *bp, size_t asize){
     // Delete node from the free list	
     deletenode(bp);
     
-	if(remainder > MINLISTSIZE){
+	if(remainder > SPLIT_MIN){
+		EVENT(EV_SPLIT, 0, bp, asize, remainder);
 		PUT(HDRP(bp), PACK(asize,1));
 		PUT(FTRP(bp), PACK(asize,1));
+		STAT_ADD(live_bytes, asize);
 		bp = NEXT_BLKP(bp);
 		PUT(HDRP(bp), PACK(remainder, 0));
 		PUT(FTRP(bp), PACK(remainder,0));
@@ -484,7 +1637,9 @@ static void place(void *bp, size_t asize){
 	}else{
 		PUT(HDRP(bp), PACK(csize,1));
 		PUT(FTRP(bp), PACK(csize,1));
+		STAT_ADD(live_bytes, csize);
 	}	
+	STAT_ADD(live_blocks, 1);
 }
 
 /* free(ptr)
@@ -496,14 +1651,59 @@ static void place(void *bp, size_t asize){
  * Return value: None
  */
 void free (void *ptr) {
+#ifdef MM_THREADS
+	unsigned hdr;
+
+	if(ptr != NULL && !GUARD_OWNS(ptr) && mm_pagemap_get(ptr) == NULL){
+		hdr = GET(HDRP(ptr));
+		if(!(hdr & (NOSHARE_BIT | TAG_BIT)) && GET_SIZE(HDRP(ptr)) <= PCPU_MAX &&
+				mm_pcpu_push(PCPU_CLASS(GET_SIZE(HDRP(ptr))), ptr)){
+			STAT_THREAD_ADD(nfree, 1);
+			return;
+		}
+	}
+#endif
+	LOCK();
+	release(ptr);
+	UNLOCK();
+}
+
+/* release(ptr)
+ *
+ * The body of free, called with the heap locked.
+ */
+static void release(void *ptr){
+	PHASE_SCOPE(PH_FREE);
+	mm_span_t *sp;
+
 	if(ptr == NULL){
 		return;
 	}
-	size_t size = GET_SIZE(HDRP(ptr));
-	PUT(HDRP(ptr), PACK(size,0));
-	PUT(FTRP(ptr), PACK(size,0));
-	insertnode(ptr, GET_SIZE(HDRP(ptr)));
-	coalesce(ptr);	
+	if(GUARD_OWNS(ptr)){
+		mm_guard_free(ptr);
+		return;
+	}
+	STAT_ADD(nfree, 1);
+	STAT_THREAD_ADD(nfree, 1);
+	STAT_TICK();
+	if((sp = mm_pagemap_get(ptr)) != NULL){
+		EVENT(EV_FREE, 0, ptr, mm_span_usable(sp), 0);
+		if(sp->kind == SPAN_SLAB){
+			slab_free(sp, ptr);
+		} else if(sp->kind == SPAN_PAGES && ptr == sp->start){
+			pages_free(sp);
+		} else {
+			fprintf(stderr, "mm_free: %s of %p in a page span\n",
+				sp->kind == SPAN_FREE ? "double free" : "invalid free", ptr);
+			abort();
+		}
+		return;
+	}
+	EVENT(EV_FREE, 0, ptr, GET_SIZE(HDRP(ptr)), 0);
+	if(GET_TAGGED(HDRP(ptr))){
+		tag_charge(ptr, GET(TAGP(ptr)), -1);
+	}
+	free_block(ptr);
     // Check heap for consistency
 	line_count++;
 	if (CHECK && CHECK_FREE) {
@@ -511,30 +1711,174 @@ void free (void *ptr) {
 	}
 }
 
+/* free_block(bp)
+ *
+ * Returns allocated block bp to the free lists.
+ */
+static void free_block(void *bp){
+	size_t size = GET_SIZE(HDRP(bp));
+
+	STAT_SUB(live_bytes, size);
+	STAT_SUB(live_blocks, 1);
+	PUT(HDRP(bp), PACK(size,0));
+	PUT(FTRP(bp), PACK(size,0));
+	insertnode(bp, size);
+	bp = coalesce(bp);
+	if(seg_empty(bp)){
+		// keep one empty segment; unmap any other
+		if(spare_seg != NULL && spare_seg != bp && seg_empty(spare_seg)){
+			drop_segment(bp);
+		} else {
+			spare_seg = bp;
+		}
+	}
+}
+
+/* seg_empty(bp)
+ *
+ * Whether bp is a free block between a segment's sentinels, that is the
+ * whole segment.
+ */
+static int seg_empty(void *bp){
+	return (char *)bp > (char *)mem_heap_hi() && !GET_ALLOC(HDRP(bp)) &&
+			GET(HDRP(bp) - WSIZE) == PACK(DSIZE,1) &&
+			GET(HDRP(NEXT_BLKP(bp))) == PACK(0,1);
+}
+
+/*
+ * mm_usable_size - bytes that may be used at ptr
+ */
+size_t mm_usable_size(void *ptr){
+	mm_span_t *sp;
+	size_t size;
+
+	if(ptr == NULL){
+		return 0;
+	}
+	if(GUARD_OWNS(ptr)){
+		return mm_guard_size(ptr);
+	}
+	if((sp = mm_pagemap_get(ptr)) != NULL){
+		return mm_span_usable(sp);
+	}
+	size = GET_SIZE(HDRP(ptr));
+	if(GET_NOSHARE(HDRP(ptr))){
+		// an unsplit tail past the last whole line is shared with the
+		// next block's payload
+		size &= ~(size_t)(LINESIZE - 1);
+	}
+	if(GET_TAGGED(HDRP(ptr))){
+		return size - DSIZE - WSIZE;
+	}
+	return size - DSIZE;
+}
+
+/*
+ * mm_heap_advise - madvise the pages of block ptr, or of the whole heap
+ */
+int mm_heap_advise(void *ptr, int how){
+	static const int advice[] = {
+		[MM_ADVISE_NORMAL] = MADV_NORMAL,
+		[MM_ADVISE_SEQUENTIAL] = MADV_SEQUENTIAL,
+		[MM_ADVISE_RANDOM] = MADV_RANDOM,
+	};
+	int rc;
+
+	if(how < 0 || how > MM_ADVISE_RANDOM){
+		return -1;
+	}
+	LOCK();
+	rc = mem_advise(ptr, mm_usable_size(ptr), advice[how]);
+	UNLOCK();
+	return rc;
+}
+
+/*
+ * mm_heap_sync - msync the dirty pages of block ptr, or of the whole heap
+ */
+int mm_heap_sync(void *ptr){
+	int rc;
+
+	LOCK();
+	rc = mem_sync(ptr, mm_usable_size(ptr));
+	UNLOCK();
+	return rc;
+}
+
 /*
  * realloc - you may want to look at mm-naive.c
  */
 void *realloc(void *ptr, size_t size) {
+	void *newptr;
+
+	LOCK();
+	newptr = reallocate(ptr, size);
+	UNLOCK();
+	return newptr;
+}
+
+/* reallocate(ptr, size)
+ *
+ * The body of realloc, called with the heap locked.
+ */
+static void *reallocate(void *ptr, size_t size) {
+	PHASE_SCOPE(PH_REALLOC);
 	size_t oldsize;
 	void *newptr;
     size_t asize;
+	int flags;
+	mm_span_t *sp;
 	if(size == 0) {
-		free(ptr);
+		release(ptr);
 		return 0;
 	}
 
 	if(ptr == NULL) {
-		return malloc(size);
+		return allocate(size, default_flags);
+	}
+	if((sp = mm_pagemap_get(ptr)) != NULL) {
+		oldsize = mm_span_usable(sp);
+		EVENT(EV_REALLOC, 0, ptr, size, oldsize);
+		STAT_ADD(nrealloc, 1);
+		if(size <= oldsize) {
+			return ptr;
+		}
+		if((newptr = allocate(size, default_flags)) == NULL) {
+			return 0;
+		}
+		move_payload(newptr, ptr, oldsize);
+		release(ptr);
+		return newptr;
+	}
+	if(GUARD_OWNS(ptr)) {
+		if((newptr = allocate(size, default_flags)) == NULL) {
+			return 0;
+		}
+		move_payload(newptr, ptr, MIN(size, mm_guard_size(ptr)));
+		mm_guard_free(ptr);
+		return newptr;
+	}
+	if(GET_TAGGED(HDRP(ptr))) {
+		// moved, so that the tag word stays in front of the footer
+		flags = (GET(TAGP(ptr)) << TAG_SHIFT) |
+			(GET_NOSHARE(HDRP(ptr)) ? MM_NOSHARE : default_flags);
+		if((newptr = allocate(size, flags)) == NULL) {
+			return 0;
+		}
+		move_payload(newptr, ptr, MIN(size, mm_usable_size(ptr)));
+		release(ptr);
+		return newptr;
 	}
    
      /* Adjust block size to include overhead and alignment reqs. */
-    if (size <=  DSIZE) {
-        asize= 2*DSIZE;
-    } else {
-		// round up to the nearest multiple of 8
-		asize = DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE);
+	asize = ADJUST(size);
+	flags = GET_NOSHARE(HDRP(ptr)) ? MM_NOSHARE : default_flags;
+	if(flags & MM_NOSHARE){
+		asize = (asize + LINESIZE - 1) & ~(size_t)(LINESIZE - 1);
 	}
     oldsize = GET_SIZE(HDRP(ptr));
+	EVENT(EV_REALLOC, 0, ptr, size, oldsize);
+	STAT_ADD(nrealloc, 1);
      
 	if(asize == oldsize){
         return ptr;
@@ -546,25 +1890,24 @@ void *realloc(void *ptr, size_t size) {
 		 * return the pointer */
 		if(oldsize - size <= 2*DSIZE)
 			return ptr;
-		PUT(HDRP(ptr), PACK(size, 1));
-		PUT(FTRP(ptr), PACK(size, 1));
+		PUT(HDRP(ptr), PACK(size, 1 | GET_NOSHARE(HDRP(ptr))));
+		PUT(FTRP(ptr), GET(HDRP(ptr)));
 		PUT(HDRP(NEXT_BLKP(ptr)), PACK(oldsize-size, 1));
-		free(NEXT_BLKP(ptr));
+		STAT_ADD(live_blocks, 1); // the tail is freed as a block of its own
+		free_block(NEXT_BLKP(ptr));
 		return ptr;
     }
 
-	newptr = malloc(size);
+	newptr = allocate(size, flags);
 
 	if(!newptr) {
 		return 0;
 	}
 
-	if(size < oldsize){
-		oldsize = size;
-	}
-	memcpy(newptr, ptr, oldsize);
+	// only the payload is live: not the header and footer oldsize counts
+	move_payload(newptr, ptr, MIN(size, oldsize - DSIZE));
 
-	free(ptr);
+	release(ptr);
 
     // Check heap for consistency
     line_count++;
@@ -574,6 +1917,110 @@ void *realloc(void *ptr, size_t size) {
 	return newptr;
 }
 
+/* move_payload(dst, src, n)
+ *
+ * Copies the n live payload bytes of a block realloc moves.
+ */
+static void move_payload(void *dst, const void *src, size_t n){
+	PHASE_SCOPE(PH_COPY);
+
+	mm_copy(dst, src, n);
+}
+
+/*
+ * mm_try_resize - resize block ptr in place, never moving it
+ */
+size_t mm_try_resize(void *ptr, size_t min_size, size_t desired_size){
+	PHASE_SCOPE(PH_REALLOC);
+	size_t minsize, asize, size;
+
+	if(ptr == NULL){
+		return 0;
+	}
+	LOCK();
+	if(GUARD_OWNS(ptr) || mm_pagemap_get(ptr) != NULL){
+		// guard slots, slab objects and page runs have a fixed size
+		size = mm_usable_size(ptr);
+		UNLOCK();
+		return size;
+	}
+	desired_size = MAX(desired_size, min_size);
+	minsize = ADJUST(min_size);
+	asize = ADJUST(desired_size);
+	if(GET_TAGGED(HDRP(ptr))){
+		// room for the tag word, as in allocate
+		if(minsize - DSIZE - min_size < WSIZE){
+			minsize += ALIGNMENT;
+		}
+		if(asize - DSIZE - desired_size < WSIZE){
+			asize += ALIGNMENT;
+		}
+	}
+	if(GET_NOSHARE(HDRP(ptr))){
+		minsize = (minsize + LINESIZE - 1) & ~(size_t)(LINESIZE - 1);
+		asize = (asize + LINESIZE - 1) & ~(size_t)(LINESIZE - 1);
+	}
+	EVENT(EV_REALLOC, 1, ptr, desired_size, GET_SIZE(HDRP(ptr)));
+	STAT_ADD(nrealloc, 1);
+	resize_block(ptr, minsize, asize);
+	size = mm_usable_size(ptr);
+	UNLOCK();
+	return size;
+}
+
+/* resize_block(ptr, minsize, asize)
+ *
+ * Changes the size of heap block ptr to asize bytes in place, or to as
+ * close to it as the free block after ptr and the top of the sbrk heap
+ * allow, but leaves the block alone if that is less than minsize. A
+ * smaller block gives its tail back to the free lists.
+ */
+static void resize_block(void *ptr, size_t minsize, size_t asize){
+	unsigned bits = GET(HDRP(ptr)) & (NOSHARE_BIT | TAG_BIT);
+	unsigned tag = (bits & TAG_BIT) ? GET(TAGP(ptr)) : 0;
+	size_t size = GET_SIZE(HDRP(ptr));
+	size_t avail = size;
+	char *next = NEXT_BLKP(ptr);
+
+	if(!GET_ALLOC(HDRP(next))){
+		avail += GET_SIZE(HDRP(next));
+	}
+	// a block that ends at the top of the sbrk heap grows with the heap,
+	// by at least a whole block; the split below returns any excess
+	if(avail < asize && seg_min == 0 &&
+			HDRP((char *)ptr + avail) == (char *)mem_heap_hi() + 1 - WSIZE &&
+			grow_heap(MAX(asize - avail, MINBLOCKSIZE)) != NULL){
+		avail = size + GET_SIZE(HDRP(next));
+	}
+	if(avail < minsize){
+		return;
+	}
+
+	if(tag){
+		tag_charge(ptr, tag, -1);
+	}
+	if(avail > size){
+		deletenode(next);
+		STAT_ADD(live_bytes, avail - size);
+		size = avail;
+		PUT(HDRP(ptr), PACK(size, 1 | bits));
+		PUT(FTRP(ptr), GET(HDRP(ptr)));
+	}
+	if(size > asize && size - asize >= MINBLOCKSIZE){
+		EVENT(EV_SPLIT, 0, ptr, asize, size - asize);
+		PUT(HDRP(ptr), PACK(asize, 1 | bits));
+		PUT(FTRP(ptr), GET(HDRP(ptr)));
+		next = NEXT_BLKP(ptr);
+		PUT(HDRP(next), PACK(size - asize, 1));
+		STAT_ADD(live_blocks, 1); // the tail is freed as a block of its own
+		free_block(next);
+	}
+	if(tag){
+		PUT(TAGP(ptr), tag);
+		tag_charge(ptr, tag, 1);
+	}
+}
+
 /*
  * calloc - you may want to look at mm-naive.c
  * This function is not tested by mdriver, but it is
@@ -595,7 +2042,7 @@ void *calloc (size_t nmemb, size_t size) {
  * May be useful for debugging.
  */
 static int in_heap(const void *p) {
-    return p <= mem_heap_hi() && p >= mem_heap_lo();
+    return mem_in_heap(p, p);
 }
 
 /*
@@ -631,8 +2078,10 @@ static int aligned(const void *p) {
  * segregated list)
  */
 void mm_checkheap(int lineno) {
-    char *ptr = heap_listp + DSIZE;
     long freeblockcount = 0; // free block counter
+	char *seg;
+	size_t segsize;
+	int i;
 
 	if(heap_listp == NULL){
 		printf("Head list pointer is NULL,heap is not initialized properly\n");
@@ -655,6 +2104,33 @@ void mm_checkheap(int lineno) {
                                                  GET_SIZE(heap_listp-WSIZE));
 	}
 
+	freeblockcount += checkblocks(heap_listp + DSIZE);
+
+	//Each segment has its own prologue and epilogue
+	for(i = 0; (seg = mem_segment(i, &segsize)) != NULL; i++){
+		if(GET(seg + WSIZE) != PACK(DSIZE,1) ||
+				GET(seg + 2*WSIZE) != PACK(DSIZE,1) ||
+				GET(seg + segsize - WSIZE) != PACK(0,1)){
+			printf("Segment %p does not have valid sentinels\n", seg);
+		}
+		freeblockcount += checkblocks(seg + 4*WSIZE);
+	}
+	long d;
+    d = checkfreeblocks();
+    if(freeblockcount != d){
+		printf("memcheck done for lineno = %d",lineno);
+		printf("Free block count is not same while checking in free lists and \
+                                                iterating through blocks \n");
+    }
+}
+
+/*
+ * Checks the blocks from ptr up to the next epilogue and returns how
+ * many are free
+ */
+static long checkblocks(char *ptr){
+    long freeblockcount = 0;
+
 	for(  ; GET_SIZE(HDRP(ptr)) > 0 ; ptr = NEXT_BLKP(ptr)){
 		checkblock(ptr);
 		if(!GET_ALLOC(HDRP(ptr))){
@@ -668,13 +2144,7 @@ void mm_checkheap(int lineno) {
 
 		}
 	}
-	long d;
-    d = checkfreeblocks();
-    if(freeblockcount != d){
-		printf("memcheck done for lineno = %d",lineno);
-		printf("Free block count is not same while checking in free lists and \
-                                                iterating through blocks \n");
-    }
+	return freeblockcount;
 }
 
 /*
@@ -690,8 +2160,12 @@ static long checkfreeblocks(){
 	unsigned size;
 	unsigned alloc;
 
-    for(index = 0; index <= MAXLIST; index++){
-		temp = GET(freeblocklist + (WSIZE * index));
+    for(index = 0; index < NLISTS; index++){
+		temp = GET(LISTP(index));
+		if((temp != 0) != ((binmap[index / 64] >> (index % 64)) & 1)){
+			printf("Bitmap bit of free list %d does not match the list\n",
+																	index);
+		}
 		while(temp != 0){
 			liststart = offset + temp;
             if(!in_heap(liststart)){
@@ -704,6 +2178,10 @@ static long checkfreeblocks(){
    
 				size = GET_SIZE(HDRP(liststart));
 				alloc = GET_ALLOC(HDRP(liststart));
+				if(listindex(size) != index){
+					printf("%p: block of size %u is in free list %d\n",
+												liststart, size, index);
+				}
 
                 if(GET(HDRP(liststart)) != GET(FTRP(liststart))){
                         printf("HEADER doesnt match footer for the freelist \
@@ -1,5 +1,17 @@
+#ifndef __MM_H_
+#define __MM_H_
+
 #include <stdio.h>
 
+/* Payloads are aligned to MM_ALIGNMENT bytes. A build with -DMM_ALIGN16
+   matches alignof(max_align_t) on x86-64, for SSE loads, long double
+   and __int128. */
+#ifdef MM_ALIGN16
+#define MM_ALIGNMENT 16
+#else
+#define MM_ALIGNMENT 8
+#endif
+
 #ifdef DRIVER
 
 /* declare functions for driver tests */
@@ -20,5 +32,56 @@ extern void *calloc (size_t nmemb, size_t size);
 
 extern int mm_init(void);
 
+/* Rotate the cache-set offset of requests of at least min bytes
+   (0 turns this off); MM_COLOR sets it at mm_init. */
+extern void mm_set_color(size_t min);
+
+/* Flags for mm_malloc_flags */
+#define MM_NOSHARE 0x1  /* the block shares no cache line with another */
+
+/* malloc with flags; the MM_NOSHARE environment variable applies
+   MM_NOSHARE to every allocation */
+extern void *mm_malloc_flags(size_t size, int flags);
+
+/* malloc preferring a free block within a page of the live block hint
+   (NULL: none), for allocating the nodes of a linked structure next to
+   one another */
+extern void *mm_malloc_near(size_t size, void *hint);
+
+/* Tags attribute heap usage to subsystems; tag 0 means untagged */
+#define MM_NTAGS 16
+
+/* malloc charging the block to tag (1 .. MM_NTAGS-1); realloc keeps the
+   tag */
+extern void *mm_malloc_tagged(size_t size, int tag);
+
+/* Live bytes (whole blocks) and blocks charged to tag */
+extern void mm_tag_usage(int tag, size_t *bytes, size_t *blocks);
+
+/* Bytes that may be used at ptr (at least the size requested) */
+extern size_t mm_usable_size(void *ptr);
+
+/* Resize block ptr in place to desired_size bytes, or as near to it as
+   possible without moving it, but not below min_size; shrinking always
+   succeeds. Never copies. Returns the usable size afterwards, which is
+   less than min_size if the block could not grow that far and was left
+   as it was. */
+extern size_t mm_try_resize(void *ptr, size_t min_size, size_t desired_size);
+
+/* Access pattern hints for mm_heap_advise */
+#define MM_ADVISE_NORMAL     0
+#define MM_ADVISE_SEQUENTIAL 1  /* read ahead aggressively */
+#define MM_ADVISE_RANDOM     2  /* do not read ahead */
+
+/* Hint how the pages of block ptr (NULL: the whole heap) will be
+   accessed; returns -1 on failure */
+extern int mm_heap_advise(void *ptr, int how);
+
+/* Write the dirty pages of block ptr (NULL: the whole heap) back to the
+   heap file (MM_HEAP_FILE) and wait for them; returns -1 on failure */
+extern int mm_heap_sync(void *ptr);
+
 /* This is largely for debugging. */
 extern void mm_checkheap(int lineno);
+
+#endif /* __MM_H_ */
@@ -0,0 +1,176 @@
+/*
+ * mm_top.c - live view of a running allocator's published counters
+ *
+ * usage: mm_top [-b] [-i <secs>] [-n <count>] <pid>
+ *     -b         batch mode: append samples instead of redrawing
+ *     -i <secs>  seconds between samples (default 1)
+ *     -n <count> stop after count samples (default: run until killed)
+ *
+ * The target process must have been started with MM_STATS set in its
+ * environment so that the allocator publishes /mm_stats.<pid>. mm_top
+ * only maps that page read-only; it never stops or signals the target.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "mmstats.h"
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: mm_top [-b] [-i <secs>] [-n <count>] <pid>\n");
+    exit(1);
+}
+
+/*
+ * stats_read - take a consistent snapshot of the page (seqlock reader)
+ */
+static void stats_read(const mm_stats_t *page, mm_stats_t *snap)
+{
+    uint32_t seq;
+
+    for (;;) {
+        seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+            continue;
+        memcpy(snap, page, sizeof(*snap));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) == seq)
+            return;
+    }
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* rate of a monotonic counter between two snapshots */
+#define RATE(field) ((double)(cur.field - prev.field) / dt)
+
+int main(int argc, char **argv)
+{
+    char name[64];
+    int c, fd, batch = 0, count = -1, i;
+    double interval = 1.0, t, tprev, dt;
+    const mm_stats_t *page;
+    mm_stats_t cur, prev;
+    pid_t pid;
+
+    while ((c = getopt(argc, argv, "bi:n:h")) != EOF) {
+        switch (c) {
+        case 'b':
+            batch = 1;
+            break;
+        case 'i':
+            interval = atof(optarg);
+            break;
+        case 'n':
+            count = atoi(optarg);
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc - 1 || interval <= 0)
+        usage();
+    pid = atoi(argv[optind]);
+
+    snprintf(name, sizeof(name), STATS_NAME, (int)pid);
+    if ((fd = shm_open(name, O_RDONLY, 0)) < 0) {
+        fprintf(stderr, "mm_top: no stats page for pid %d "
+                "(was it started with MM_STATS=1?)\n", (int)pid);
+        exit(1);
+    }
+    page = mmap(NULL, sizeof(mm_stats_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        perror("mm_top: mmap");
+        exit(1);
+    }
+    if (page->magic != STATS_MAGIC || page->version != STATS_VERSION) {
+        fprintf(stderr, "mm_top: %s is not a version %d stats page\n",
+                name, STATS_VERSION);
+        exit(1);
+    }
+
+    stats_read(page, &prev);
+    tprev = now();
+    while (count != 0) {
+        usleep((useconds_t)(interval * 1e6));
+        stats_read(page, &cur);
+        t = now();
+        dt = t - tprev;
+
+        if (!batch)
+            printf("\033[H\033[J");
+        printf("mm_top  pid %d  heap %.1f MB  live %.1f MB (%.1f%%)  "
+               "blocks %lu\n", (int)pid, cur.heap_size / 1048576.0,
+               cur.live_bytes / 1048576.0,
+               cur.heap_size ? 100.0 * cur.live_bytes / cur.heap_size : 0.0,
+               (unsigned long)cur.live_blocks);
+        printf("  %-8s %14s %12s\n", "", "total", "per sec");
+        printf("  %-8s %14lu %12.0f\n", "malloc",
+               (unsigned long)cur.nmalloc, RATE(nmalloc));
+        printf("  %-8s %14lu %12.0f\n", "free",
+               (unsigned long)cur.nfree, RATE(nfree));
+        printf("  %-8s %14lu %12.0f\n", "realloc",
+               (unsigned long)cur.nrealloc, RATE(nrealloc));
+        printf("  %-8s %14lu %12.0f  (%.1f KB/s)\n", "extend",
+               (unsigned long)cur.nextend, RATE(nextend),
+               RATE(extend_bytes) / 1024.0);
+        printf("  %-8s %14lu %12.0f  (%.1f KB/s)\n", "purge",
+               (unsigned long)cur.npurge, RATE(npurge),
+               RATE(purge_bytes) / 1024.0);
+
+        printf("free bytes by bucket:\n");
+        for (i = 0; i < (int)cur.nbuckets && i < STATS_NBUCKETS; i++)
+            if (cur.bucket_free[i] != 0)
+                printf("  [%3d] %12lu\n", i,
+                       (unsigned long)cur.bucket_free[i]);
+
+        printf("dedicated size classes:");
+        for (i = 0; i < STATS_NHOT; i++)
+            if (cur.hot_size[i] != 0)
+                printf(" %u", cur.hot_size[i]);
+        printf("\n");
+
+        printf("threads:\n  %10s %12s %12s %14s\n",
+               "tid", "malloc/s", "free/s", "bytes/s");
+        for (i = 0; i < STATS_NTHREADS; i++) {
+            if (cur.thread[i].tid == 0)
+                continue;
+            printf("  %10d %12.0f %12.0f %14.0f\n", (int)cur.thread[i].tid,
+                   RATE(thread[i].nmalloc), RATE(thread[i].nfree),
+                   RATE(thread[i].malloc_bytes));
+        }
+        printf("tags:\n  %4s %14s %10s\n", "tag", "live bytes", "blocks");
+        for (i = 1; i < STATS_NTAGS; i++) {
+            int64_t bytes = 0, blocks = 0;
+            int j;
+
+            for (j = 0; j < STATS_NTHREADS; j++) {
+                bytes += cur.thread[j].tag_bytes[i];
+                blocks += cur.thread[j].tag_blocks[i];
+            }
+            if (blocks != 0)
+                printf("  %4d %14lld %10lld\n", i, (long long)bytes,
+                       (long long)blocks);
+        }
+        if (batch)
+            printf("\n");
+
+        prev = cur;
+        tprev = t;
+        if (count > 0)
+            count--;
+    }
+    return 0;
+}
@@ -0,0 +1,399 @@
+/*
+ * mmbench.c - micro-benchmarks for placement policies
+ *
+ * Each benchmark starts from a fresh simulated heap (mem_init/mm_init),
+ * allocates its blocks with mm_malloc and times a payload-touching
+ * kernel with fsecs, once per allocator setting it compares.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "mmbench.h"
+#include "mm.h"
+#include "memlib.h"
+#include "fsecs.h"
+
+typedef struct {
+    const char *name;
+    const char *desc;
+    void (*run)(void);
+} bench_t;
+
+/*
+ * colors: column-wise scan over several large arrays at once
+ */
+#define COLOR_NBUF    16            /* more than the L1 associativity */
+#define COLOR_BUFSIZE (64 * 1024)
+
+typedef struct {
+    long *buf[COLOR_NBUF];
+    size_t n;                       /* longs per buffer */
+} color_arg_t;
+
+static volatile long color_sink;
+
+static void color_scan(void *argp)
+{
+    color_arg_t *a = argp;
+    long s = 0;
+    size_t i;
+    int k;
+
+    for (i = 0; i < a->n; i++) {
+        for (k = 0; k < COLOR_NBUF - 1; k++)
+            s += a->buf[k][i];
+        a->buf[COLOR_NBUF - 1][i] = s;
+    }
+    color_sink = s;
+}
+
+/*
+ * color_once - allocate the arrays with coloring at min (0 = off) and
+ *     time one scan
+ */
+static void color_once(const char *label, size_t min)
+{
+    color_arg_t a;
+    int k, offsets[COLOR_NBUF], ndistinct = 0, j;
+    double secs;
+
+    mem_init();
+    mm_init();
+    mm_set_color(min);
+    a.n = COLOR_BUFSIZE / sizeof(long);
+    for (k = 0; k < COLOR_NBUF; k++) {
+        if ((a.buf[k] = mm_malloc(COLOR_BUFSIZE)) == NULL) {
+            fprintf(stderr, "colors: mm_malloc failed\n");
+            exit(1);
+        }
+        memset(a.buf[k], k, COLOR_BUFSIZE);
+        offsets[k] = (int)((size_t)a.buf[k] % 4096);
+        for (j = 0; j < k && offsets[j] / 64 != offsets[k] / 64; j++)
+            ;
+        if (j == k)
+            ndistinct++;
+    }
+
+    secs = fsecs(color_scan, &a);
+    printf("  %-12s %8.2f ns/row  %2d distinct line offsets mod 4K\n",
+           label, secs * 1e9 / a.n, ndistinct);
+
+    for (k = 0; k < COLOR_NBUF; k++)
+        mm_free(a.buf[k]);
+    mem_deinit();
+}
+
+static void bench_colors(void)
+{
+    printf("colors: %d arrays of %d KB, one column of all of them per row\n",
+           COLOR_NBUF, COLOR_BUFSIZE / 1024);
+    color_once("uncolored", 0);
+    color_once("colored", COLOR_BUFSIZE);
+}
+
+/*
+ * scratch: each thread allocates a small object and then writes it in a
+ * loop (after Hoard's cache-scratch). The allocator is not thread-safe,
+ * so the allocations are serialized; only the writes run in parallel.
+ */
+#define SCRATCH_NTHREADS 4
+#define SCRATCH_OBJSIZE  8
+#define SCRATCH_WRITES   (1 << 20)
+
+typedef struct {
+    pthread_barrier_t *barrier;
+    int flags;                      /* for mm_malloc_flags */
+    char *obj;
+} scratch_arg_t;
+
+static pthread_mutex_t scratch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *scratch_thread(void *argp)
+{
+    scratch_arg_t *a = argp;
+    volatile long *p;
+    int i;
+
+    pthread_mutex_lock(&scratch_lock);
+    a->obj = mm_malloc_flags(SCRATCH_OBJSIZE, a->flags);
+    pthread_mutex_unlock(&scratch_lock);
+    p = (volatile long *)a->obj;
+    *p = 0;
+    pthread_barrier_wait(a->barrier);
+    for (i = 0; i < SCRATCH_WRITES; i++)
+        (*p)++;
+    return NULL;
+}
+
+static void scratch_run(void *argp)
+{
+    scratch_arg_t *a = argp;
+    pthread_t tid[SCRATCH_NTHREADS];
+    pthread_barrier_t barrier;
+    int t;
+
+    pthread_barrier_init(&barrier, NULL, SCRATCH_NTHREADS);
+    for (t = 0; t < SCRATCH_NTHREADS; t++) {
+        a[t].barrier = &barrier;
+        pthread_create(&tid[t], NULL, scratch_thread, &a[t]);
+    }
+    for (t = 0; t < SCRATCH_NTHREADS; t++)
+        pthread_join(tid[t], NULL);
+    for (t = 0; t < SCRATCH_NTHREADS; t++)
+        mm_free(a[t].obj);
+    pthread_barrier_destroy(&barrier);
+}
+
+/*
+ * scratch_once - time the threads with objects allocated with flags
+ */
+static void scratch_once(const char *label, int flags)
+{
+    scratch_arg_t a[SCRATCH_NTHREADS];
+    int t, lines = 0, j;
+    double secs;
+
+    mem_init();
+    mm_init();
+    for (t = 0; t < SCRATCH_NTHREADS; t++)
+        a[t].flags = flags;
+    secs = fsecs(scratch_run, a);
+
+    /* the last run's objects were freed in the same order, so a fresh
+       run lands them at the same places */
+    for (t = 0; t < SCRATCH_NTHREADS; t++) {
+        for (j = 0; j < t && (size_t)a[j].obj / 64 != (size_t)a[t].obj / 64;
+             j++)
+            ;
+        if (j == t)
+            lines++;
+    }
+    printf("  %-12s %8.2f ns/write  %d objects in %d cache lines\n",
+           label, secs * 1e9 / SCRATCH_WRITES, SCRATCH_NTHREADS, lines);
+    mem_deinit();
+}
+
+static void bench_scratch(void)
+{
+    printf("scratch: %d threads each writing its own %d-byte object\n",
+           SCRATCH_NTHREADS, SCRATCH_OBJSIZE);
+    scratch_once("default", 0);
+    scratch_once("MM_NOSHARE", MM_NOSHARE);
+}
+
+/*
+ * chase: build a linked list on a heap whose free blocks are scattered
+ * at random, then walk it. Plain malloc takes each node from the head of
+ * a free list, which is anywhere in the heap; mm_malloc_near takes a
+ * free block next to the previous node.
+ */
+#define CHASE_NODES   (1 << 16)
+#define CHASE_FILLERS (4 * CHASE_NODES)   /* half of them freed */
+
+typedef struct chase_node {
+    struct chase_node *next;
+    long val[3];
+} chase_node_t;
+
+static volatile long chase_sink;
+
+static void chase_walk(void *argp)
+{
+    chase_node_t *n;
+    long s = 0;
+
+    for (n = argp; n != NULL; n = n->next)
+        s += n->val[0];
+    chase_sink = s;
+}
+
+/*
+ * chase_once - fragment a fresh heap, build the list with mm_malloc_near
+ *     (near) or mm_malloc, and time one walk
+ */
+static void chase_once(const char *label, int near)
+{
+    static void *filler[CHASE_FILLERS];
+    chase_node_t *head = NULL, *tail = NULL, *n;
+    void *tmp;
+    int i, j, samepage = 0;
+    double secs;
+
+    mem_init();
+    mm_init();
+    srand(1);
+    for (i = 0; i < CHASE_FILLERS; i++)
+        filler[i] = mm_malloc(sizeof(chase_node_t));
+    /* free a random half, in random order */
+    for (i = CHASE_FILLERS - 1; i > 0; i--) {
+        j = rand() % (i + 1);
+        tmp = filler[i];
+        filler[i] = filler[j];
+        filler[j] = tmp;
+    }
+    for (i = 0; i < CHASE_FILLERS / 2; i++)
+        mm_free(filler[i]);
+
+    for (i = 0; i < CHASE_NODES; i++) {
+        n = near ? mm_malloc_near(sizeof(*n), tail)
+                 : mm_malloc(sizeof(*n));
+        if (n == NULL) {
+            fprintf(stderr, "chase: mm_malloc failed\n");
+            exit(1);
+        }
+        n->next = NULL;
+        n->val[0] = i;
+        if (tail == NULL)
+            head = n;
+        else
+            tail->next = n;
+        if (tail != NULL && (size_t)tail / 4096 == (size_t)n / 4096)
+            samepage++;
+        tail = n;
+    }
+
+    secs = fsecs(chase_walk, head);
+    printf("  %-12s %8.2f ns/node  %5.1f%% of hops within a page\n",
+           label, secs * 1e9 / CHASE_NODES,
+           100.0 * samepage / (CHASE_NODES - 1));
+    mem_deinit();
+}
+
+static void bench_chase(void)
+{
+    printf("chase: walk a %d-node list built on a heap with %d scattered "
+           "free blocks\n", CHASE_NODES, CHASE_FILLERS / 2);
+    chase_once("mm_malloc", 0);
+    chase_once("malloc_near", 1);
+}
+
+/*
+ * resize: grow many buffers a little at a time, as a growing vector does
+ */
+#define RESIZE_NBUF 64
+#define RESIZE_STEP 24              /* not a multiple of the alignment */
+#define RESIZE_MAX  4096
+
+typedef struct {
+    int inplace;                    /* try mm_try_resize before realloc */
+    long moves;                     /* reallocs that moved the buffer */
+    long bad;                       /* buffers that lost their contents */
+} resize_arg_t;
+
+static void resize_run(void *argp)
+{
+    resize_arg_t *a = argp;
+    char *buf[RESIZE_NBUF], *p;
+    size_t n, got;
+    int k;
+
+    mem_reset_brk();
+    mm_init();
+    a->moves = a->bad = 0;
+    for (k = 0; k < RESIZE_NBUF; k++) {
+        if ((buf[k] = mm_malloc(RESIZE_STEP)) == NULL) {
+            fprintf(stderr, "resize: mm_malloc failed\n");
+            exit(1);
+        }
+        memset(buf[k], k, RESIZE_STEP);
+    }
+    for (n = 2 * RESIZE_STEP; n <= RESIZE_MAX; n += RESIZE_STEP) {
+        for (k = 0; k < RESIZE_NBUF; k++) {
+            got = a->inplace ? mm_try_resize(buf[k], n, n + n / 2) : 0;
+            if (got < n) {
+                if ((p = mm_realloc(buf[k], n)) == NULL) {
+                    fprintf(stderr, "resize: mm_realloc failed\n");
+                    exit(1);
+                }
+                if (p != buf[k])
+                    a->moves++;
+                buf[k] = p;
+            }
+            if (buf[k][0] != (char)k || buf[k][n - RESIZE_STEP - 1] != (char)k)
+                a->bad++;
+            memset(buf[k] + n - RESIZE_STEP, k, RESIZE_STEP);
+        }
+    }
+    for (k = 0; k < RESIZE_NBUF; k++)
+        mm_free(buf[k]);
+}
+
+/*
+ * resize_top - grow the block at the top of a fresh heap by less than
+ *     the smallest block, so the heap has to be extended by more than
+ *     the difference; returns 0 if the block or the heap came out wrong
+ */
+static int resize_top(void)
+{
+    char *p;
+    int ok = 0;
+
+    mem_init();
+    mm_init();
+    if ((p = mm_malloc(248)) != NULL) {
+        memset(p, 1, 248);
+        ok = mm_try_resize(p, 256, 256) >= 256 && p[247] == 1;
+        mm_checkheap(__LINE__);     /* prints what it finds wrong */
+    }
+    mem_deinit();
+    return ok;
+}
+
+static void resize_once(const char *label, int inplace)
+{
+    resize_arg_t a;
+    double secs;
+
+    mem_init();
+    a.inplace = inplace;
+    secs = fsecs(resize_run, &a);
+    printf("  %-12s %8.2f ns/step  %6ld moves  %ld bad\n", label,
+           secs * 1e9 / (RESIZE_NBUF * (RESIZE_MAX / RESIZE_STEP - 1)),
+           a.moves, a.bad);
+    mem_deinit();
+}
+
+static void bench_resize(void)
+{
+    printf("resize: grow %d buffers %d bytes at a time to %d bytes\n",
+           RESIZE_NBUF, RESIZE_STEP, RESIZE_MAX);
+    printf("  heap-top grow by 8 bytes: %s\n", resize_top() ? "ok" : "FAILED");
+    resize_once("mm_realloc", 0);
+    resize_once("try_resize", 1);
+}
+
+static const bench_t benches[] = {
+    { "colors", "scan several large arrays together, with and without "
+      "cache coloring", bench_colors },
+    { "scratch", "threads writing objects they allocated, with and "
+      "without MM_NOSHARE", bench_scratch },
+    { "chase", "walk a linked list allocated with and without "
+      "mm_malloc_near", bench_chase },
+    { "resize", "grow buffers in small steps with mm_realloc and with "
+      "mm_try_resize", bench_resize },
+};
+
+#define NBENCHES ((int)(sizeof(benches) / sizeof(benches[0])))
+
+int mm_bench_run(const char *name)
+{
+    int i;
+
+    for (i = 0; i < NBENCHES; i++) {
+        if (strcmp(benches[i].name, name) == 0) {
+            benches[i].run();
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void mm_bench_list(FILE *fp)
+{
+    int i;
+
+    for (i = 0; i < NBENCHES; i++)
+        fprintf(fp, "\t  %-10s %s\n", benches[i].name, benches[i].desc);
+}
@@ -0,0 +1,20 @@
+/*
+ * mmbench.h - micro-benchmarks for placement policies
+ *
+ * The traces measure how fast the allocator itself is; these benchmarks
+ * measure how fast a program runs on the memory it hands out, by
+ * touching the payloads in a given pattern under different allocator
+ * settings. Run them with "mdriver -b <name>".
+ */
+#ifndef __MMBENCH_H_
+#define __MMBENCH_H_
+
+#include <stdio.h>
+
+/* Run benchmark name; returns -1 if there is no such benchmark */
+int mm_bench_run(const char *name);
+
+/* List the benchmarks on fp */
+void mm_bench_list(FILE *fp);
+
+#endif /* __MMBENCH_H_ */
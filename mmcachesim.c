@@ -0,0 +1,219 @@
+/*
+ * mmcachesim.c - set-associative LRU models of the caches and TLBs
+ *
+ * Each level is an array of sets of tags with a last-use stamp per way.
+ * A line that misses in L1 is looked up in L2 and then in the LLC, and
+ * is filled into every level it missed in; the TLBs work the same way
+ * on page numbers.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "mmcachesim.h"
+
+typedef struct {
+    const char *name;
+    size_t size;            /* bytes (caches) or entries (TLBs) */
+    int ways;
+    size_t nsets;
+    uint64_t *tag;          /* nsets * ways; 0 = empty, else number + 1 */
+    uint64_t *stamp;
+} level_t;
+
+mm_cachesim_counts_t mm_cachesim[CS_NKINDS];
+
+static level_t levels[CS_NLEVELS] = {
+    [CS_L1]   = { "L1",   32 << 10, 8 },
+    [CS_L2]   = { "L2",   1 << 20, 16 },
+    [CS_LLC]  = { "LLC",  32 << 20, 16 },
+    [CS_TLB]  = { "TLB",  64, 4 },
+    [CS_STLB] = { "STLB", 1536, 12 },
+};
+static size_t line = 64;
+static size_t page = 4096;
+static uint64_t now;
+static char config[256];
+static int configured = 0;
+
+/*
+ * parse_size - a number with an optional K, M or G suffix
+ */
+static size_t parse_size(const char *s, char **end)
+{
+    size_t n = strtoul(s, end, 0);
+
+    switch (**end) {
+    case 'k': case 'K': n <<= 10; (*end)++; break;
+    case 'm': case 'M': n <<= 20; (*end)++; break;
+    case 'g': case 'G': n <<= 30; (*end)++; break;
+    }
+    return n;
+}
+
+/*
+ * configure - apply MM_CACHESIM and size the levels
+ */
+static void configure(void)
+{
+    char *env = getenv("MM_CACHESIM"), *buf, *kv, *val, *end;
+    int lv;
+
+    if (env != NULL && (buf = strdup(env)) != NULL) {
+        for (kv = strtok(buf, ","); kv != NULL; kv = strtok(NULL, ",")) {
+            if ((val = strchr(kv, '=')) == NULL)
+                goto bad;
+            *val++ = '\0';
+            if (strcmp(kv, "line") == 0) {
+                line = parse_size(val, &end);
+                continue;
+            }
+            if (strcmp(kv, "page") == 0) {
+                page = parse_size(val, &end);
+                continue;
+            }
+            for (lv = 0; lv < CS_NLEVELS; lv++)
+                if (strcasecmp(kv, levels[lv].name) == 0)
+                    break;
+            if (lv == CS_NLEVELS)
+                goto bad;
+            levels[lv].size = parse_size(val, &end);
+            if (*end == ':')
+                levels[lv].ways = atoi(end + 1);
+            continue;
+        bad:
+            fprintf(stderr, "MM_CACHESIM: ignoring \"%s\"\n", kv);
+        }
+        free(buf);
+    }
+    if (line == 0 || (line & (line - 1)) != 0)
+        line = 64;
+    if (page != 4096 && page != (2 << 20))
+        page = 4096;
+
+    for (lv = 0; lv < CS_NLEVELS; lv++) {
+        level_t *l = &levels[lv];
+        size_t units = lv < CS_TLB ? l->size / line : l->size;
+
+        if (l->ways <= 0 || (size_t)l->ways > units)
+            l->ways = units > 0 ? units : 1;
+        l->nsets = units / l->ways > 0 ? units / l->ways : 1;
+        l->tag = calloc(l->nsets * l->ways, sizeof(uint64_t));
+        l->stamp = calloc(l->nsets * l->ways, sizeof(uint64_t));
+        if (l->tag == NULL || l->stamp == NULL) {
+            fprintf(stderr, "MM_CACHESIM: out of memory\n");
+            exit(1);
+        }
+    }
+    snprintf(config, sizeof(config),
+             "L1 %zuK/%d, L2 %zuK/%d, LLC %zuK/%d, %zu-byte lines, "
+             "TLB %zu/%d, STLB %zu/%d, %zuK pages",
+             levels[CS_L1].size >> 10, levels[CS_L1].ways,
+             levels[CS_L2].size >> 10, levels[CS_L2].ways,
+             levels[CS_LLC].size >> 10, levels[CS_LLC].ways, line,
+             levels[CS_TLB].size, levels[CS_TLB].ways,
+             levels[CS_STLB].size, levels[CS_STLB].ways, page >> 10);
+    configured = 1;
+}
+
+/*
+ * lookup - look n up in level l and make it the most recently used
+ *     entry of its set; returns 0 on a miss (after filling it in)
+ */
+static int lookup(level_t *l, uint64_t n)
+{
+    size_t base = (n % l->nsets) * l->ways;
+    uint64_t *tag = l->tag + base, *stamp = l->stamp + base;
+    int w, victim = 0;
+
+    now++;
+    for (w = 0; w < l->ways; w++) {
+        if (tag[w] == n + 1) {
+            stamp[w] = now;
+            return 1;
+        }
+        if (stamp[w] < stamp[victim])
+            victim = w;
+    }
+    tag[victim] = n + 1;
+    stamp[victim] = now;
+    return 0;
+}
+
+/*
+ * mm_cachesim_reset - empty every level and zero the counters
+ */
+void mm_cachesim_reset(void)
+{
+    int lv;
+
+    if (!configured)
+        configure();
+    for (lv = 0; lv < CS_NLEVELS; lv++) {
+        memset(levels[lv].tag, 0,
+               levels[lv].nsets * levels[lv].ways * sizeof(uint64_t));
+        memset(levels[lv].stamp, 0,
+               levels[lv].nsets * levels[lv].ways * sizeof(uint64_t));
+    }
+    memset(mm_cachesim, 0, sizeof(mm_cachesim));
+    now = 0;
+}
+
+/*
+ * mm_cachesim_touch - run each line of [p, p + len) through the TLBs
+ *     and the caches
+ */
+void mm_cachesim_touch(const void *p, size_t len, int kind)
+{
+    mm_cachesim_counts_t *c = &mm_cachesim[kind];
+    uint64_t a, end;
+
+    if (!configured || len == 0)
+        return;
+    end = ((uint64_t)(uintptr_t)p + len - 1) / line;
+    for (a = (uint64_t)(uintptr_t)p / line; a <= end; a++) {
+        c->accesses++;
+        if (!lookup(&levels[CS_TLB], a * line / page)) {
+            c->miss[CS_TLB]++;
+            if (!lookup(&levels[CS_STLB], a * line / page))
+                c->miss[CS_STLB]++;
+        }
+        if (!lookup(&levels[CS_L1], a)) {
+            c->miss[CS_L1]++;
+            if (!lookup(&levels[CS_L2], a)) {
+                c->miss[CS_L2]++;
+                if (!lookup(&levels[CS_LLC], a))
+                    c->miss[CS_LLC]++;
+            }
+        }
+    }
+}
+
+/*
+ * mm_cachesim_config - the configuration in effect, as text
+ */
+const char *mm_cachesim_config(void)
+{
+    return config;
+}
+
+/*
+ * mm_cachesim_level - name of level lv
+ */
+const char *mm_cachesim_level(int lv)
+{
+    return (lv >= 0 && lv < CS_NLEVELS) ? levels[lv].name : "?";
+}
+
+/*
+ * mm_cachesim_enabled - nonzero in an MM_CACHESIM build
+ */
+int mm_cachesim_enabled(void)
+{
+#ifdef MM_CACHESIM
+    return 1;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,67 @@
+/*
+ * mmcachesim.h - deterministic cache and TLB simulation
+ *
+ * Built with -DMM_CACHESIM (e.g. "make DEFS=-DMM_CACHESIM"), every word
+ * the allocator reads or writes through GET and PUT, and every payload
+ * the driver touches, is fed through a model of a set-associative cache
+ * hierarchy (L1, L2, LLC, all LRU, filled on every miss) and a two-level
+ * TLB. mdriver -S replays each trace once through the model and prints
+ * the miss counts, which unlike cycle counts do not change from run to
+ * run, so that layouts can be compared on small differences. Set
+ * indices depend on addresses, so mdriver -S runs itself again with
+ * address space randomization turned off.
+ *
+ * The hierarchy is set with MM_CACHESIM, a comma-separated list of
+ * key=value pairs; the defaults are
+ *     l1=32K:8,l2=1M:16,llc=32M:16,line=64,tlb=64:4,stlb=1536:12,page=4K
+ * where caches are size:ways, TLBs entries:ways, and page is 4K or 2M.
+ */
+#ifndef __MMCACHESIM_H_
+#define __MMCACHESIM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Who touched the memory */
+#define CS_META     0   /* the allocator, through GET/PUT */
+#define CS_PAYLOAD  1   /* the program, in a payload */
+#define CS_NKINDS   2
+
+/* Levels counted */
+#define CS_L1       0
+#define CS_L2       1
+#define CS_LLC      2
+#define CS_TLB      3   /* first-level TLB */
+#define CS_STLB     4   /* second-level TLB (a page walk) */
+#define CS_NLEVELS  5
+
+typedef struct {
+    uint64_t accesses;              /* cache lines touched */
+    uint64_t miss[CS_NLEVELS];
+} mm_cachesim_counts_t;
+
+extern mm_cachesim_counts_t mm_cachesim[CS_NKINDS];
+
+/* Empty the caches and zero the counters; the first call reads the
+   configuration */
+void mm_cachesim_reset(void);
+
+/* Touch the len bytes at p on behalf of kind */
+void mm_cachesim_touch(const void *p, size_t len, int kind);
+
+/* The configuration, as a line of text */
+const char *mm_cachesim_config(void);
+
+/* Name of level lv */
+const char *mm_cachesim_level(int lv);
+
+/* Nonzero if the allocator was built with MM_CACHESIM */
+int mm_cachesim_enabled(void);
+
+#ifdef MM_CACHESIM
+#define CACHESIM_TOUCH(p, len) mm_cachesim_touch((p), (len), CS_META)
+#else
+#define CACHESIM_TOUCH(p, len) ((void)0)
+#endif
+
+#endif /* __MMCACHESIM_H_ */
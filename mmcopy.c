@@ -0,0 +1,63 @@
+/*
+ * mmcopy.c - streaming copies for large realloc moves
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <emmintrin.h>
+
+#include "mmcopy.h"
+
+#define PREFETCH_AHEAD 512  /* bytes of source prefetched ahead */
+
+size_t mm_copy_nt_min = COPY_NT_DEFAULT;
+
+void mm_copy_init(void)
+{
+    const char *env = getenv("MM_COPY_NT");
+    long llc;
+
+    if (env != NULL) {
+        mm_copy_nt_min = strtoul(env, NULL, 0);
+        if (mm_copy_nt_min == 0)
+            mm_copy_nt_min = SIZE_MAX;
+        return;
+    }
+    llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    mm_copy_nt_min = llc > 0 ? (size_t)llc / 2 : COPY_NT_DEFAULT;
+}
+
+/*
+ * mm_copy_stream - copy the unaligned head with memcpy, then whole
+ *     cache lines of the destination with SSE2 streaming stores, then
+ *     the tail; the sfence orders the streamed lines before any later
+ *     store
+ */
+void mm_copy_stream(void *dst, const void *src, size_t n)
+{
+    char *d = dst;
+    const char *s = src;
+    size_t head = -(uintptr_t)d & 63;
+    __m128i a, b, c, e;
+
+    if (head > n)
+        head = n;
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+
+    for (; n >= 64; n -= 64, d += 64, s += 64) {
+        _mm_prefetch(s + PREFETCH_AHEAD, _MM_HINT_NTA);
+        a = _mm_loadu_si128((const __m128i *)s);
+        b = _mm_loadu_si128((const __m128i *)(s + 16));
+        c = _mm_loadu_si128((const __m128i *)(s + 32));
+        e = _mm_loadu_si128((const __m128i *)(s + 48));
+        _mm_stream_si128((__m128i *)d, a);
+        _mm_stream_si128((__m128i *)(d + 16), b);
+        _mm_stream_si128((__m128i *)(d + 32), c);
+        _mm_stream_si128((__m128i *)(d + 48), e);
+    }
+    _mm_sfence();
+    memcpy(d, s, n);
+}
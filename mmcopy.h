@@ -0,0 +1,39 @@
+/*
+ * mmcopy.h - the copy engine realloc moves payloads with
+ *
+ * Copies below mm_copy_nt_min bytes go to memcpy, whose glibc versions
+ * already pick SSE2, AVX2 or "rep movsb" code for the CPU at load time
+ * and are as fast as a hand-vectorized loop at every size. Larger
+ * copies stream: the source is prefetched ahead and the destination is
+ * written with non-temporal stores, so that a multi-megabyte move does
+ * not evict the heap's working set for data that will not be touched
+ * again soon.
+ *
+ * The threshold is half the last-level cache, or MM_COPY_NT=n bytes
+ * from the environment (0 never streams), read by mm_copy_init.
+ */
+#ifndef __MMCOPY_H_
+#define __MMCOPY_H_
+
+#include <stddef.h>
+#include <string.h>
+
+#define COPY_NT_DEFAULT (4 << 20)  /* threshold if the LLC size is unknown */
+
+extern size_t mm_copy_nt_min;
+
+/* Set the streaming threshold; called by mm_init */
+void mm_copy_init(void);
+
+/* Copy n bytes with prefetch and non-temporal stores */
+void mm_copy_stream(void *dst, const void *src, size_t n);
+
+static inline void mm_copy(void *dst, const void *src, size_t n)
+{
+    if (n < mm_copy_nt_min)
+        memcpy(dst, src, n);
+    else
+        mm_copy_stream(dst, src, n);
+}
+
+#endif /* __MMCOPY_H_ */
@@ -0,0 +1,138 @@
+/*
+ * mmevent.c - per-thread event rings for allocator tracing
+ *
+ * Each thread lazily maps its own ring the first time it records an
+ * event and pushes it onto a global list with a CAS, so recording never
+ * takes a lock. Rings are mapped with mmap rather than malloc'd because
+ * the allocator being traced may itself be malloc.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "mmevent.h"
+
+typedef struct ev_ring {
+    struct ev_ring *next;   /* next ring on the global list */
+    uint32_t tid;
+    uint64_t head;          /* total records ever written */
+    uint64_t size;          /* records in rec[] (power of two) */
+    mm_event_t rec[];
+} ev_ring_t;
+
+static ev_ring_t *rings;            /* all rings, newest first */
+static __thread ev_ring_t *my_ring; /* the calling thread's ring */
+static uint64_t ring_size;          /* records per ring, 0 until read */
+
+/*
+ * ring_create - map a ring for the calling thread and publish it
+ */
+static ev_ring_t *ring_create(void)
+{
+    ev_ring_t *r;
+    const char *env;
+    uint64_t n = ring_size;
+
+    if (n == 0) {
+        n = EV_RING_SIZE;
+        if ((env = getenv("MM_EVENT_RING")) != NULL && atol(env) > 0)
+            for (n = 1; n < (uint64_t)atol(env); n <<= 1)
+                ;
+        ring_size = n;
+    }
+
+    r = mmap(NULL, sizeof(ev_ring_t) + n * sizeof(mm_event_t),
+             PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (r == MAP_FAILED)
+        return NULL;
+    r->tid = (uint32_t)syscall(SYS_gettid);
+    r->head = 0;
+    r->size = n;
+    r->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&rings, &r->next, r, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+    return r;
+}
+
+/*
+ * mm_event_record - append one record to the calling thread's ring
+ */
+void mm_event_record(int type, int sub, const void *addr,
+                     uint32_t size, uint32_t aux)
+{
+    ev_ring_t *r = my_ring;
+    mm_event_t *e;
+
+    if (r == NULL && (r = my_ring = ring_create()) == NULL)
+        return;
+
+    e = &r->rec[r->head & (r->size - 1)];
+    e->tsc = __builtin_ia32_rdtsc();
+    e->addr = (uint64_t)(uintptr_t)addr;
+    e->size = size;
+    e->aux = aux;
+    e->type = (uint8_t)type;
+    e->sub = (uint8_t)sub;
+    e->pad = 0;
+    e->seq = (uint32_t)r->head;
+    __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * mm_event_reset - forget everything recorded so far
+ */
+void mm_event_reset(void)
+{
+    ev_ring_t *r;
+
+    for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next)
+        __atomic_store_n(&r->head, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * mm_event_dump - write every ring to path, oldest records first
+ */
+int mm_event_dump(const char *path)
+{
+#ifdef MM_EVENTS
+    FILE *fp;
+    ev_ring_t *r, *first;
+    mm_evfile_t fh;
+    mm_evring_t rh;
+    uint64_t head, start, i;
+
+    if ((fp = fopen(path, "wb")) == NULL)
+        return -1;
+
+    first = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+    fh.magic = EV_MAGIC;
+    fh.version = EV_VERSION;
+    fh.record_size = sizeof(mm_event_t);
+    fh.nrings = 0;
+    for (r = first; r; r = r->next)
+        fh.nrings++;
+    fwrite(&fh, sizeof(fh), 1, fp);
+
+    for (r = first; r; r = r->next) {
+        head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        start = (head > r->size) ? head - r->size : 0;
+        rh.tid = r->tid;
+        rh.nrecords = (uint32_t)(head - start);
+        rh.dropped = start;
+        fwrite(&rh, sizeof(rh), 1, fp);
+        for (i = start; i < head; i++)
+            fwrite(&r->rec[i & (r->size - 1)], sizeof(mm_event_t), 1, fp);
+    }
+
+    if (fclose(fp) != 0)
+        return -1;
+    return 0;
+#else
+    (void)path;
+    return -1;
+#endif
+}
@@ -0,0 +1,94 @@
+/*
+ * mmevent.h - allocator-internal event tracing
+ *
+ * The allocator records what it does internally (splits, the four
+ * coalesce cases, heap extensions, free list inserts/deletes and the
+ * number of blocks probed per search) as fixed-size records in a
+ * per-thread ring buffer. Each ring has a single writer, so recording
+ * an event is a few plain stores; once a ring fills up the oldest
+ * records are overwritten and counted as dropped in the dump. The
+ * MM_EVENT_RING environment variable sets the number of records per
+ * ring (rounded up to a power of two, default EV_RING_SIZE); it is read
+ * when the first ring is created.
+ *
+ * Recording is compiled in only with -DMM_EVENTS
+ * (e.g. "make DEFS=-DMM_EVENTS"). Otherwise EVENT() expands to nothing
+ * and the allocator pays nothing for it. Use mm_event_dump() to write
+ * the rings to a binary file and the evdecode tool to read it back.
+ */
+#ifndef __MMEVENT_H_
+#define __MMEVENT_H_
+
+#include <stdint.h>
+
+/* Event types */
+#define EV_MALLOC    1 /* size = request, aux = adjusted size */
+#define EV_FREE      2 /* size = block size */
+#define EV_REALLOC   3 /* size = request, aux = old block size;
+                          sub = 1 for mm_try_resize */
+#define EV_SPLIT     4 /* size = allocated part, aux = remainder;
+                          sub = 1 for a leading (cache coloring) split,
+                          where size is the part split off */
+#define EV_COALESCE  5 /* sub = case (1-4), size = resulting block size */
+#define EV_EXTEND    6 /* size = bytes added to the heap; sub = 1 if
+                          they are a new segment, 2 if a segment of
+                          size bytes was unmapped */
+#define EV_INSERT    7 /* sub = free list index, size = block size */
+#define EV_DELETE    8 /* sub = free list index, size = block size */
+#define EV_SEARCH    9 /* sub = last list searched (255 for the blocks
+                          around mm_malloc_near's hint), size = request,
+                          aux = blocks probed; addr = 0 if no fit */
+#define EV_NTYPES   10
+
+/* One event record; the on-disk format uses the same layout */
+typedef struct {
+    uint64_t tsc;      /* cycle counter when the event was recorded */
+    uint64_t addr;     /* block pointer the event refers to (or 0) */
+    uint32_t size;     /* see the event types above */
+    uint32_t aux;
+    uint8_t  type;     /* EV_xxx */
+    uint8_t  sub;
+    uint16_t pad;
+    uint32_t seq;      /* per-ring sequence number (low 32 bits) */
+} mm_event_t;
+
+/* Default number of records in each per-thread ring (power of two) */
+#define EV_RING_SIZE (1 << 16)
+
+/* Dump file layout: an mm_evfile_t, then for each ring an mm_evring_t
+   followed by nrecords mm_event_t records, oldest first */
+#define EV_MAGIC   0x56454d4d /* "MMEV" */
+#define EV_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size; /* sizeof(mm_event_t) */
+    uint32_t nrings;
+} mm_evfile_t;
+
+typedef struct {
+    uint32_t tid;         /* thread that owned the ring */
+    uint32_t nrecords;    /* records that follow */
+    uint64_t dropped;     /* older records lost to wrap-around */
+} mm_evring_t;
+
+/* Record an event in the calling thread's ring */
+void mm_event_record(int type, int sub, const void *addr,
+                     uint32_t size, uint32_t aux);
+
+/* Discard all recorded events */
+void mm_event_reset(void);
+
+/* Write all rings to path; returns 0 on success, -1 on error (including
+   when the allocator was built without MM_EVENTS) */
+int mm_event_dump(const char *path);
+
+#ifdef MM_EVENTS
+#define EVENT(type, sub, addr, size, aux) \
+    mm_event_record((type), (sub), (addr), (size), (aux))
+#else
+#define EVENT(type, sub, addr, size, aux) ((void)0)
+#endif
+
+#endif /* __MMEVENT_H_ */
@@ -0,0 +1,295 @@
+/*
+ * mmguard.c - guard-page pool for sampled allocations
+ *
+ * Pool layout, one page per cell (G = guard page, D = data page):
+ *
+ *     G D0 G D1 G ... G Dn-1 G
+ *
+ * Data page i is readable and writable only while slot i holds a live
+ * block; guard pages are never accessible. A fault on any pool page is
+ * therefore a bug in the program, and the page it hit tells which slot
+ * it concerns.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <execinfo.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "mm.h"
+#include "mmguard.h"
+
+#define SLOT_UNUSED 0
+#define SLOT_LIVE   1
+#define SLOT_FREED  2
+
+typedef struct {
+    char *addr;             /* payload */
+    size_t size;            /* requested size */
+    int state;              /* SLOT_xxx */
+    int alloc_depth;
+    int free_depth;
+    uint32_t alloc_tid;
+    uint32_t free_tid;
+    void *alloc_trace[GUARD_DEPTH];
+    void *free_trace[GUARD_DEPTH];
+} guard_slot_t;
+
+int mm_guard_countdown = 0;
+char *mm_guard_lo, *mm_guard_hi;
+
+static guard_slot_t slots[GUARD_MAXSLOTS];
+static int nslots = GUARD_SLOTS;
+static int rate = 0;
+static int next_slot;           /* where the search for a free slot starts */
+static size_t pagesize;
+static struct sigaction old_segv;
+static int initialized = 0;
+
+#define DATA_PAGE(i) (mm_guard_lo + (2 * (size_t)(i) + 1) * pagesize)
+
+/*
+ * report - write a formatted line to stderr from the fault handler
+ */
+static void report(const char *fmt, ...)
+    __attribute__((format(printf, 1, 2)));
+static void report(const char *fmt, ...)
+{
+    char buf[256];
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n > (int)sizeof(buf) - 1)
+        n = sizeof(buf) - 1;
+    if (write(STDERR_FILENO, buf, n) < 0)
+        return;
+}
+
+/*
+ * report_slot - print where the block in slot s was allocated and freed
+ */
+static void report_slot(const guard_slot_t *s)
+{
+    report("  %zu-byte block at %p allocated by thread %u:\n",
+           s->size, (void *)s->addr, s->alloc_tid);
+    backtrace_symbols_fd(s->alloc_trace, s->alloc_depth, STDERR_FILENO);
+    if (s->state == SLOT_FREED) {
+        report("  freed by thread %u:\n", s->free_tid);
+        backtrace_symbols_fd(s->free_trace, s->free_depth, STDERR_FILENO);
+    }
+}
+
+/*
+ * guard_fault - SIGSEGV handler: describe faults inside the pool, and
+ *     pass everything else on to the previous handler
+ */
+static void guard_fault(int sig, siginfo_t *info, void *ctx)
+{
+    char *addr = info->si_addr;
+    size_t page;
+    int i;
+
+    if (mm_guard_lo == NULL || addr < mm_guard_lo || addr >= mm_guard_hi) {
+        /* Chain to a handler, staying installed; a default or ignored
+           disposition is restored so that the retried access kills the
+           process as it would have without us */
+        if (old_segv.sa_flags & SA_SIGINFO)
+            old_segv.sa_sigaction(sig, info, ctx);
+        else if (old_segv.sa_handler != SIG_DFL &&
+                 old_segv.sa_handler != SIG_IGN)
+            old_segv.sa_handler(sig);
+        else
+            sigaction(SIGSEGV, &old_segv, NULL);
+        return;
+    }
+
+    /* The process dies on the retried access under old_segv */
+    sigaction(SIGSEGV, &old_segv, NULL);
+
+    page = (addr - mm_guard_lo) / pagesize;
+    if (page % 2 == 1) {
+        i = page / 2;
+        if (slots[i].state == SLOT_FREED) {
+            report("mm_guard: use after free at %p (offset %ld)\n",
+                   (void *)addr, (long)(addr - slots[i].addr));
+            report_slot(&slots[i]);
+        } else {
+            report("mm_guard: wild access at %p in an unused slot\n",
+                   (void *)addr);
+        }
+        return;
+    }
+
+    /* Guard page: blame the block ending just before it, else the one
+       starting after it */
+    i = page / 2 - 1;
+    if (i >= 0 && slots[i].state != SLOT_UNUSED) {
+        report("mm_guard: %s %zu bytes past the end of a block (at %p)\n",
+               slots[i].state == SLOT_FREED ? "use after free" :
+               "buffer overflow",
+               (size_t)(addr - slots[i].addr) - slots[i].size,
+               (void *)addr);
+        report_slot(&slots[i]);
+    } else if (++i < nslots && slots[i].state != SLOT_UNUSED) {
+        report("mm_guard: buffer underflow %zu bytes before a block (at %p)\n",
+               (size_t)(slots[i].addr - addr), (void *)addr);
+        report_slot(&slots[i]);
+    } else {
+        report("mm_guard: wild access at %p in a guard page\n",
+               (void *)addr);
+    }
+}
+
+/*
+ * mm_guard_init - forget the pool of the previous heap
+ */
+void mm_guard_init(void)
+{
+    const char *env;
+    void *frame;
+
+    if (!initialized) {
+        initialized = 1;
+        pagesize = sysconf(_SC_PAGESIZE);
+        if ((env = getenv("MM_GUARD_RATE")) != NULL)
+            rate = atoi(env);
+        if ((env = getenv("MM_GUARD_SLOTS")) != NULL)
+            nslots = atoi(env);
+        if (nslots < 1)
+            nslots = 1;
+        if (nslots > GUARD_MAXSLOTS)
+            nslots = GUARD_MAXSLOTS;
+        if (rate < 0)
+            rate = 0;
+        /* backtrace() loads its unwinder on first use; do that now rather
+           than from inside the allocator */
+        if (rate > 0)
+            backtrace(&frame, 1);
+    }
+
+    if (mm_guard_lo != NULL)
+        mprotect(mm_guard_lo, mm_guard_hi - mm_guard_lo,
+                 PROT_READ | PROT_WRITE);
+    mm_guard_lo = mm_guard_hi = NULL;
+    memset(slots, 0, sizeof(slots));
+    next_slot = 0;
+    mm_guard_countdown = rate;
+}
+
+/*
+ * mm_guard_poolsize - room for the pool plus a page of alignment slack
+ */
+size_t mm_guard_poolsize(void)
+{
+    return (2 * (size_t)nslots + 2) * pagesize;
+}
+
+/*
+ * mm_guard_attach - take over the pool block and protect all of it
+ */
+int mm_guard_attach(void *p, size_t size)
+{
+    struct sigaction sa;
+    char *lo = (char *)(((size_t)p + pagesize - 1) & ~(pagesize - 1));
+
+    if (lo + (2 * (size_t)nslots + 1) * pagesize > (char *)p + size ||
+        mprotect(lo, (2 * (size_t)nslots + 1) * pagesize, PROT_NONE) < 0) {
+        mm_guard_countdown = 0;
+        return -1;
+    }
+
+    /* A pool of an earlier heap may have installed the handler already;
+       keep the old_segv it saved rather than chaining to ourselves */
+    sigaction(SIGSEGV, NULL, &sa);
+    if (!(sa.sa_flags & SA_SIGINFO) || sa.sa_sigaction != guard_fault) {
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = guard_fault;
+        sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGSEGV, &sa, &old_segv);
+    }
+
+    mm_guard_lo = lo;
+    mm_guard_hi = lo + (2 * (size_t)nslots + 1) * pagesize;
+    return 0;
+}
+
+/*
+ * mm_guard_malloc - place a block at the end of a free slot's page
+ */
+void *mm_guard_malloc(size_t size)
+{
+    guard_slot_t *s;
+    char *page;
+    int i, n;
+
+    mm_guard_countdown = rate;
+    if (mm_guard_lo == NULL || size > pagesize)
+        return NULL;
+
+    i = next_slot;
+    for (n = 0; slots[i].state == SLOT_LIVE; n++) {
+        if (n == nslots - 1)
+            return NULL;    /* every slot is in use */
+        i = (i + 1) % nslots;
+    }
+    next_slot = (i + 1) % nslots;
+
+    page = DATA_PAGE(i);
+    if (mprotect(page, pagesize, PROT_READ | PROT_WRITE) < 0)
+        return NULL;
+
+    s = &slots[i];
+    s->addr = page + pagesize -
+        ((size + MM_ALIGNMENT - 1) & ~(size_t)(MM_ALIGNMENT - 1));
+    s->size = size;
+    s->state = SLOT_LIVE;
+    s->alloc_tid = (uint32_t)syscall(SYS_gettid);
+    s->alloc_depth = backtrace(s->alloc_trace, GUARD_DEPTH);
+    s->free_depth = 0;
+    return s->addr;
+}
+
+/*
+ * mm_guard_free - protect the block's page until the slot is reused
+ */
+void mm_guard_free(void *p)
+{
+    size_t page = ((char *)p - mm_guard_lo) / pagesize;
+    guard_slot_t *s;
+
+    /* The final guard page has no slot of its own */
+    if (page / 2 >= (size_t)nslots) {
+        report("mm_guard: invalid free of %p\n", p);
+        abort();
+    }
+    s = &slots[page / 2];
+    if (page % 2 == 0 || s->addr != p || s->state != SLOT_LIVE) {
+        report("mm_guard: %s of %p\n", s->state == SLOT_FREED &&
+               s->addr == p ? "double free" : "invalid free", p);
+        if (page % 2 == 1 && s->state != SLOT_UNUSED)
+            report_slot(s);
+        abort();
+    }
+
+    s->state = SLOT_FREED;
+    s->free_tid = (uint32_t)syscall(SYS_gettid);
+    s->free_depth = backtrace(s->free_trace, GUARD_DEPTH);
+    mprotect(DATA_PAGE(page / 2), pagesize, PROT_NONE);
+}
+
+/*
+ * mm_guard_size - requested size of a guarded block
+ */
+size_t mm_guard_size(const void *p)
+{
+    return slots[((char *)p - mm_guard_lo) / pagesize / 2].size;
+}
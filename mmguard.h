@@ -0,0 +1,63 @@
+/*
+ * mmguard.h - sampled guard-page allocations
+ *
+ * One in every MM_GUARD_RATE allocations (an environment variable, read
+ * when mm_init first runs; unset or 0 disables sampling) is served from
+ * a pool of page-sized slots, each flanked by PROT_NONE guard pages. The
+ * payload is placed at the end of its page so that running off the end
+ * of it faults immediately, and freeing it makes the whole page PROT_NONE
+ * so that a later use faults too. The fault handler prints what kind of
+ * access it was and where the block was allocated and freed, then lets
+ * the fault kill the process as it would have anyway.
+ *
+ * The pool is one ordinary allocated block of the heap, carved out the
+ * first time an allocation is sampled, so guarded pointers stay inside
+ * the heap. MM_GUARD_SLOTS sets the number of slots (default
+ * GUARD_SLOTS); freed slots are reused oldest first, which keeps a freed
+ * page protected for as long as possible.
+ *
+ * With sampling disabled the cost is one compare per malloc and a range
+ * check per free and realloc.
+ */
+#ifndef __MMGUARD_H_
+#define __MMGUARD_H_
+
+#include <stddef.h>
+
+#define GUARD_SLOTS    16   /* default number of slots */
+#define GUARD_MAXSLOTS 256
+#define GUARD_DEPTH    16   /* stack frames kept per allocation and free */
+
+/* Allocations left until the next sample; 0 while sampling is disabled */
+extern int mm_guard_countdown;
+
+/* The pool's slots and guard pages, or NULL before the first sample */
+extern char *mm_guard_lo, *mm_guard_hi;
+
+/* Forget the pool of the previous heap and restore its protections;
+   the first call also reads the environment */
+void mm_guard_init(void);
+
+/* Bytes the allocator must provide for the pool */
+size_t mm_guard_poolsize(void);
+
+/* Hand the pool block (of at least mm_guard_poolsize() bytes) over;
+   -1 if it cannot be used, in which case sampling is turned off and the
+   block stays the caller's */
+int mm_guard_attach(void *p, size_t size);
+
+/* Serve a sampled allocation; NULL if it does not fit in a slot */
+void *mm_guard_malloc(size_t size);
+
+/* Free a guarded block; aborts with a report on a double or invalid free */
+void mm_guard_free(void *p);
+
+/* Requested size of a guarded block */
+size_t mm_guard_size(const void *p);
+
+#define GUARD_SAMPLE() \
+    (mm_guard_countdown != 0 && --mm_guard_countdown == 0)
+#define GUARD_OWNS(p) \
+    ((char *)(p) >= mm_guard_lo && (char *)(p) < mm_guard_hi)
+
+#endif /* __MMGUARD_H_ */
@@ -0,0 +1,122 @@
+/*
+ * mmpagemap.c - radix-tree page map and the span descriptor pool
+ *
+ * Leaves and descriptors are mmap'd rather than taken from the heap, so
+ * nothing an overrun of a heap object can reach describes a span.
+ */
+#include <string.h>
+#include <sys/mman.h>
+
+#include "mmpagemap.h"
+
+#define LEAF_BYTES (sizeof(mm_span_t *) << MAP_LEAF_BITS)
+#define POOL_SPANS 4096     /* descriptors per pool chunk */
+#define MAX_LEAVES 64       /* leaves remembered for a quick reset */
+
+mm_span_t **mm_pagemap_root[1 << MAP_ROOT_BITS];
+
+typedef struct span_chunk {
+    struct span_chunk *next;
+    mm_span_t span[POOL_SPANS];
+} span_chunk_t;
+
+static span_chunk_t *chunks;    /* all pool chunks */
+static span_chunk_t *cur;       /* chunk being carved */
+static int nused;               /* descriptors carved from cur */
+static mm_span_t *freed;        /* descriptors given back (via next) */
+static int leaves[MAX_LEAVES];  /* root indices of the mapped leaves */
+static int nleaves;             /* more than MAX_LEAVES: scan the root */
+
+/*
+ * mm_pagemap_set - point each page of [start, start + npages pages) at
+ *     span
+ */
+int mm_pagemap_set(const void *start, size_t npages, mm_span_t *span)
+{
+    uintptr_t page = (uintptr_t)start >> MM_PAGE_SHIFT;
+    mm_span_t ***root;
+    void *leaf;
+
+    for (; npages > 0; npages--, page++) {
+        root = &mm_pagemap_root[(page >> MAP_LEAF_BITS) &
+                                ((1 << MAP_ROOT_BITS) - 1)];
+        if (*root == NULL) {
+            if (span == NULL)
+                continue;
+            leaf = mmap(NULL, LEAF_BYTES, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (leaf == MAP_FAILED)
+                return -1;
+            *root = leaf;
+            if (nleaves < MAX_LEAVES)
+                leaves[nleaves] = root - mm_pagemap_root;
+            nleaves++;
+        }
+        (*root)[page & ((1 << MAP_LEAF_BITS) - 1)] = span;
+    }
+    return 0;
+}
+
+/*
+ * mm_pagemap_reset - unmap every leaf and recycle every descriptor
+ */
+void mm_pagemap_reset(void)
+{
+    int i, n = nleaves <= MAX_LEAVES ? nleaves : 1 << MAP_ROOT_BITS;
+
+    for (i = 0; i < n; i++) {
+        int r = nleaves <= MAX_LEAVES ? leaves[i] : i;
+
+        if (mm_pagemap_root[r] != NULL) {
+            munmap(mm_pagemap_root[r], LEAF_BYTES);
+            mm_pagemap_root[r] = NULL;
+        }
+    }
+    nleaves = 0;
+    cur = chunks;
+    nused = 0;
+    freed = NULL;
+}
+
+/*
+ * mm_span_new - take a descriptor from the free list or the pool
+ */
+mm_span_t *mm_span_new(void)
+{
+    mm_span_t *s;
+    span_chunk_t *c;
+
+    if ((s = freed) != NULL) {
+        freed = s->next;
+    } else {
+        if (cur == NULL || nused == POOL_SPANS) {
+            if (cur != NULL && cur->next != NULL) {
+                cur = cur->next;    /* reuse a chunk from an older heap */
+            } else {
+                c = mmap(NULL, sizeof(span_chunk_t), PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (c == MAP_FAILED)
+                    return NULL;
+                c->next = NULL;
+                if (cur != NULL)
+                    cur->next = c;
+                else
+                    chunks = c;
+                cur = c;
+            }
+            nused = 0;
+        }
+        s = &cur->span[nused++];
+    }
+    memset(s, 0, sizeof(*s));
+    return s;
+}
+
+/*
+ * mm_span_delete - put a descriptor on the free list
+ */
+void mm_span_delete(mm_span_t *span)
+{
+    span->next = freed;
+    freed = span;
+}
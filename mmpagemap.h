@@ -0,0 +1,84 @@
+/*
+ * mmpagemap.h - out-of-band page map and span descriptors
+ *
+ * A span is a run of whole pages that the allocator manages as a unit: a
+ * slab page of equal-sized small objects, or a run of pages of the page
+ * heap (one medium object, or free pages). Its descriptor
+ * lives outside the heap, and a two-level radix tree maps every page
+ * number of the span to it, so that free and realloc can find out what
+ * a pointer is without reading anything next to the object.
+ *
+ * The tree covers 48-bit addresses: the top MAP_ROOT_BITS of the page
+ * number index a static root array, the rest a leaf that is mapped on
+ * first use. A lookup is two dependent loads.
+ */
+#ifndef __MMPAGEMAP_H_
+#define __MMPAGEMAP_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MM_PAGE_SHIFT 12
+#define MM_PAGE_SIZE  (1UL << MM_PAGE_SHIFT)
+
+#define MAP_ROOT_BITS 18
+#define MAP_LEAF_BITS (48 - MM_PAGE_SHIFT - MAP_ROOT_BITS)
+
+/* Span kinds */
+#define SPAN_SLAB 1         /* equal-sized objects without headers */
+#define SPAN_PAGES 2        /* one object taking all pages */
+#define SPAN_FREE 3         /* free pages of the page heap */
+#define SPAN_REGION 4       /* a region of the page heap (not mapped) */
+
+#define SPAN_MAXOBJS (MM_PAGE_SIZE / 8)
+
+typedef struct mm_span {
+    uint8_t kind;           /* SPAN_xxx */
+    uint8_t cls;            /* size class */
+    uint16_t size;          /* object size */
+    uint16_t nobjs;         /* objects in the span */
+    uint16_t nfree;         /* of which free */
+    uint32_t owner;         /* thread that created the span */
+    uint32_t npages;
+    char *start;            /* first byte of the first page */
+    struct mm_span *next;   /* on the allocator's list for cls */
+    struct mm_span *prev;
+    struct mm_span *region; /* SPAN_PAGES/FREE: region the pages are in */
+    uint64_t freemap[SPAN_MAXOBJS / 64]; /* bit set = object free */
+} mm_span_t;
+
+extern mm_span_t **mm_pagemap_root[1 << MAP_ROOT_BITS];
+
+/* Map the npages pages from start to span (NULL to unmap); returns -1 if
+   a leaf could not be mapped */
+int mm_pagemap_set(const void *start, size_t npages, mm_span_t *span);
+
+/* Forget all mappings and descriptors (for a fresh heap) */
+void mm_pagemap_reset(void);
+
+/* Get a zeroed descriptor, or NULL; and give one back */
+mm_span_t *mm_span_new(void);
+void mm_span_delete(mm_span_t *span);
+
+/*
+ * mm_pagemap_get - the span containing p, or NULL
+ */
+static inline mm_span_t *mm_pagemap_get(const void *p)
+{
+    uintptr_t page = (uintptr_t)p >> MM_PAGE_SHIFT;
+    mm_span_t **leaf = mm_pagemap_root[(page >> MAP_LEAF_BITS) &
+                                       ((1 << MAP_ROOT_BITS) - 1)];
+
+    return leaf ? leaf[page & ((1 << MAP_LEAF_BITS) - 1)] : NULL;
+}
+
+/*
+ * mm_span_usable - bytes usable by an object of span sp
+ */
+static inline size_t mm_span_usable(const mm_span_t *sp)
+{
+    return sp->kind == SPAN_SLAB ? (size_t)sp->size
+                                 : (size_t)sp->npages << MM_PAGE_SHIFT;
+}
+
+#endif /* __MMPAGEMAP_H_ */
@@ -0,0 +1,37 @@
+/*
+ * mmpcpu.c - storage for the per-CPU block caches
+ */
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "mmpcpu.h"
+
+char *mm_pcpu_base;
+
+static size_t ncpus;
+static int initialized = 0;
+
+/*
+ * mm_pcpu_init - map one pcpu_cache_t per configured CPU, if the kernel
+ *     and glibc registered an rseq area for us; empty the caches
+ */
+void mm_pcpu_init(void)
+{
+    void *p;
+
+    if (!initialized) {
+        initialized = 1;
+        if (__rseq_size == 0)
+            return;
+        ncpus = sysconf(_SC_NPROCESSORS_CONF);
+        p = mmap(NULL, ncpus * sizeof(pcpu_cache_t), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED)
+            mm_pcpu_base = p;
+        return;
+    }
+
+    if (mm_pcpu_base != NULL)
+        memset(mm_pcpu_base, 0, ncpus * sizeof(pcpu_cache_t));
+}
@@ -0,0 +1,156 @@
+/*
+ * mmpcpu.h - per-CPU caches of small blocks using restartable sequences
+ *
+ * Each CPU has, for every block size from 16 to PCPU_MAX bytes, a small
+ * stack of free blocks. A push or pop runs as a Linux rseq critical
+ * section: it reads the current CPU number, indexes that CPU's stack and
+ * commits with a single store. If the thread is preempted, migrated or
+ * signalled inside the section, the kernel restarts it at the abort
+ * label, so no atomics or locks are needed and the caches take memory
+ * per CPU rather than per thread.
+ *
+ * The rseq area is the one glibc (2.35 and later) registers for every
+ * thread. If registration failed, mm_pcpu_base stays NULL and every push
+ * and pop fails, so the allocator falls back to its locked path.
+ *
+ * Cached blocks stay marked allocated in the heap; the caches only hold
+ * them between a free and the next malloc of the same size.
+ */
+#ifndef __MMPCPU_H_
+#define __MMPCPU_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/rseq.h>
+
+#include "mm.h"
+
+#define PCPU_MAX      256                   /* largest block size cached */
+#define PCPU_NCLASSES ((PCPU_MAX - 16) / MM_ALIGNMENT + 1) /* 16 .. PCPU_MAX */
+#define PCPU_DEPTH    31                    /* blocks per class per CPU */
+
+/* Class of a block size of at most PCPU_MAX bytes */
+#define PCPU_CLASS(size) (((size) - 16) / MM_ALIGNMENT)
+
+typedef struct {
+    uint64_t count;
+    void *slot[PCPU_DEPTH];
+} pcpu_stack_t;
+
+typedef struct {
+    pcpu_stack_t stack[PCPU_NCLASSES];
+} pcpu_cache_t;
+
+/* The caches of all CPUs, or NULL if rseq is unavailable */
+extern char *mm_pcpu_base;
+
+/* Map the caches on the first call; empty them on later calls */
+void mm_pcpu_init(void);
+
+#define PCPU_STR_(x) #x
+#define PCPU_STR(x) PCPU_STR_(x)
+
+/* Critical section descriptor 3, covering labels 1 (start) to 2 (commit
+   done), aborting to label 4; then make it the active one */
+#define PCPU_BEGIN                                                      \
+    ".pushsection __rseq_cs, \"aw\"\n\t"                                \
+    ".balign 32\n\t"                                                    \
+    "3:\n\t"                                                            \
+    ".long 0x0, 0x0\n\t"                                                \
+    ".quad 1f, (2f - 1f), 4f\n\t"                                       \
+    ".popsection\n\t"                                                   \
+    ".pushsection __rseq_cs_ptr_array, \"aw\"\n\t"                      \
+    ".quad 3b\n\t"                                                      \
+    ".popsection\n\t"                                                   \
+    "leaq 3b(%%rip), %%rax\n\t"                                         \
+    "movq %%rax, %[rseq_cs]\n\t"                                        \
+    "1:\n\t"                                                            \
+    /* rax = this CPU's stack */                                        \
+    "movl %[cpu_id], %%eax\n\t"                                         \
+    "imulq %[stride], %%rax\n\t"                                        \
+    "addq %[stk], %%rax\n\t"                                            \
+    "movq (%%rax), %%rcx\n\t"
+
+/* The abort handler, preceded by the signature the kernel checks */
+#define PCPU_END                                                        \
+    "2:\n\t"                                                            \
+    ".pushsection __rseq_failure, \"ax\"\n\t"                           \
+    ".byte 0x0f, 0xb9, 0x3d\n\t"                                        \
+    ".long " PCPU_STR(RSEQ_SIG) "\n\t"                                  \
+    "4:\n\t"                                                            \
+    "jmp %l[aborted]\n\t"                                               \
+    ".popsection\n\t"
+
+#define PCPU_RSEQ() \
+    ((struct rseq *)((char *)__builtin_thread_pointer() + __rseq_offset))
+
+/*
+ * mm_pcpu_pop - take a cached block of class cls, or NULL
+ */
+static inline void *mm_pcpu_pop(int cls)
+{
+    struct rseq *rs = PCPU_RSEQ();
+    char *stk;
+    void *p;
+
+    if (mm_pcpu_base == NULL)
+        return NULL;
+    stk = mm_pcpu_base + cls * sizeof(pcpu_stack_t);
+retry:
+    __asm__ __volatile__ goto (
+        PCPU_BEGIN
+        "testq %%rcx, %%rcx\n\t"
+        "jz %l[empty]\n\t"
+        "movq (%%rax,%%rcx,8), %%rdx\n\t"   /* slot[count - 1] */
+        "movq %%rdx, (%[p])\n\t"
+        "decq %%rcx\n\t"
+        "movq %%rcx, (%%rax)\n\t"           /* commit */
+        PCPU_END
+        : /* no outputs */
+        : [cpu_id] "m" (rs->cpu_id), [rseq_cs] "m" (rs->rseq_cs),
+          [stride] "r" ((long)sizeof(pcpu_cache_t)), [stk] "r" (stk),
+          [p] "r" (&p)
+        : "memory", "cc", "rax", "rcx", "rdx"
+        : empty, aborted);
+    return p;
+aborted:
+    goto retry;
+empty:
+    return NULL;
+}
+
+/*
+ * mm_pcpu_push - cache block p of class cls; returns 0 if the stack is
+ *     full (or there are no caches)
+ */
+static inline int mm_pcpu_push(int cls, void *p)
+{
+    struct rseq *rs = PCPU_RSEQ();
+    char *stk;
+
+    if (mm_pcpu_base == NULL)
+        return 0;
+    stk = mm_pcpu_base + cls * sizeof(pcpu_stack_t);
+retry:
+    __asm__ __volatile__ goto (
+        PCPU_BEGIN
+        "cmpq $" PCPU_STR(PCPU_DEPTH) ", %%rcx\n\t"
+        "jae %l[full]\n\t"
+        "movq %[p], 8(%%rax,%%rcx,8)\n\t"   /* slot[count] */
+        "incq %%rcx\n\t"
+        "movq %%rcx, (%%rax)\n\t"           /* commit */
+        PCPU_END
+        : /* no outputs */
+        : [cpu_id] "m" (rs->cpu_id), [rseq_cs] "m" (rs->rseq_cs),
+          [stride] "r" ((long)sizeof(pcpu_cache_t)), [stk] "r" (stk),
+          [p] "r" (p)
+        : "memory", "cc", "rax", "rcx"
+        : full, aborted);
+    return 1;
+aborted:
+    goto retry;
+full:
+    return 0;
+}
+
+#endif /* __MMPCPU_H_ */
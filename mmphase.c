@@ -0,0 +1,33 @@
+/*
+ * mmphase.c - accumulators for per-phase cycle attribution
+ */
+#include <string.h>
+
+#include "mmphase.h"
+
+mm_phase_t mm_phases[PH_NPHASES];
+__thread mm_phase_frame_t *mm_phase_cur;
+
+static const char *phase_names[PH_NPHASES] = {
+    "malloc", "free", "realloc", "find_fit", "place",
+    "coalesce", "insert", "delete", "extend", "copy"
+};
+
+void mm_phase_reset(void)
+{
+    memset(mm_phases, 0, sizeof(mm_phases));
+}
+
+const char *mm_phase_name(int ph)
+{
+    return (ph >= 0 && ph < PH_NPHASES) ? phase_names[ph] : "?";
+}
+
+int mm_phase_enabled(void)
+{
+#ifdef MM_PHASES
+    return 1;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,81 @@
+/*
+ * mmphase.h - cycle attribution for the allocator's internal phases
+ *
+ * Put PHASE_SCOPE(ph) at the top of a function to charge the cycles
+ * spent until it returns to phase ph. Phases nest: each phase records
+ * both its inclusive cycles and its self cycles (inclusive minus the
+ * time spent in phases it called), so the self column of all phases
+ * adds up to the total time spent inside the allocator.
+ *
+ * Attribution is compiled in only with -DMM_PHASES
+ * (e.g. "make DEFS=-DMM_PHASES"); otherwise PHASE_SCOPE expands to
+ * nothing. Each instrumented call costs two rdtsc reads.
+ */
+#ifndef __MMPHASE_H_
+#define __MMPHASE_H_
+
+#include <stdint.h>
+
+/* Phases */
+#define PH_MALLOC    0
+#define PH_FREE      1
+#define PH_REALLOC   2
+#define PH_FIND_FIT  3
+#define PH_PLACE     4
+#define PH_COALESCE  5
+#define PH_INSERT    6
+#define PH_DELETE    7
+#define PH_EXTEND    8
+#define PH_COPY      9
+#define PH_NPHASES   10
+
+typedef struct {
+    uint64_t calls;
+    uint64_t cycles;   /* inclusive */
+    uint64_t self;     /* exclusive of nested phases */
+} mm_phase_t;
+
+/* One activation of a phase; lives on the stack of the instrumented
+   function */
+typedef struct mm_phase_frame {
+    struct mm_phase_frame *parent;
+    uint64_t t0;
+    uint64_t child;    /* cycles spent in nested phases */
+    int phase;
+} mm_phase_frame_t;
+
+extern mm_phase_t mm_phases[PH_NPHASES];
+extern __thread mm_phase_frame_t *mm_phase_cur;
+
+/* Zero all accumulators */
+void mm_phase_reset(void);
+
+/* Name of phase ph */
+const char *mm_phase_name(int ph);
+
+/* Nonzero if the allocator was built with MM_PHASES */
+int mm_phase_enabled(void);
+
+static inline void mm_phase_exit(mm_phase_frame_t *f)
+{
+    uint64_t d = __builtin_ia32_rdtsc() - f->t0;
+    mm_phase_t *p = &mm_phases[f->phase];
+
+    p->calls++;
+    p->cycles += d;
+    p->self += d - f->child;
+    mm_phase_cur = f->parent;
+    if (f->parent != NULL)
+        f->parent->child += d;
+}
+
+#ifdef MM_PHASES
+#define PHASE_SCOPE(ph) \
+    mm_phase_frame_t __phase_frame __attribute__((cleanup(mm_phase_exit))) = \
+        { mm_phase_cur, __builtin_ia32_rdtsc(), 0, (ph) }; \
+    mm_phase_cur = &__phase_frame
+#else
+#define PHASE_SCOPE(ph) ((void)0)
+#endif
+
+#endif /* __MMPHASE_H_ */
@@ -0,0 +1,377 @@
+/*
+ * mmsearch.c - search for workloads the allocator handles worst
+ *
+ * usage: mmsearch [-m util|lat] [-n <objects>] [-s <maxsize>]
+ *                 [-i <iters>] [-k <restarts>] [-r <seed>] [-o <prefix>]
+ *     -m   minimize utilization (default) or maximize op latency
+ *     -n   objects per workload (default 200)
+ *     -s   largest request size (default 4096)
+ *     -i   mutations tried per restart (default 2000)
+ *     -k   independent restarts (default 3)
+ *     -r   random seed (default 1)
+ *     -o   prefix of the traces written (default "worst")
+ *
+ * A workload is a set of objects, each with a size, an allocation time,
+ * a free time (or none: it lives to the end) and optionally a realloc
+ * time and size. Sorting the events by time gives a trace in the
+ * driver's format, which is replayed through the allocator linked into
+ * this tool. Hill climbing mutates one object at a time and keeps the
+ * mutation unless the workload got easier for the allocator: lower
+ * utilization, computed as the driver does, or a slower slowest op,
+ * each op timed as its minimum cycles over LAT_REPS replays so that
+ * interrupts and first-touch faults do not count.
+ *
+ * Each restart writes <prefix><k>.rep, the worst trace it found, and
+ * <prefix><k>-min.rep, that trace after dropping, one by one, every
+ * object without which the score stays within MIN_SLACK of it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "mmtrace.h"
+
+#define LAT_REPS  3         /* replays per latency measurement */
+#define MIN_SLACK 0.05      /* score a minimized trace may give up */
+#define NEVER     2.0       /* free time of an object never freed */
+
+typedef struct {
+    int size;
+    int resize;             /* realloc to this size, or 0 for none */
+    double t_alloc;         /* event times in [0, 1) */
+    double t_realloc;
+    double t_free;          /* NEVER if not freed */
+} obj_t;
+
+typedef struct {
+    double t;
+    int obj;
+    char type;
+} event_t;
+
+static int lat_mode = 0;
+static int max_size = 4096;
+static uint64_t rng = 1;
+
+static uint64_t *cycles;    /* per op, for the latency score */
+static size_t ncycles;
+
+/*
+ * rnd - xorshift64*; uniform in [0, n)
+ */
+static uint64_t rnd(uint64_t n)
+{
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return (rng * 0x2545f4914f6cdd1dULL) % n;
+}
+
+static double rnd_time(double lo, double hi)
+{
+    return lo + (hi - lo) * (rnd(1 << 30) / (double)(1 << 30));
+}
+
+/*
+ * rnd_size - log-uniform in [1, max_size], so that small sizes are as
+ *     likely as large ones
+ */
+static int rnd_size(void)
+{
+    int bits = 0, s;
+
+    while ((1 << (bits + 1)) <= max_size)
+        bits++;
+    s = (1 << rnd(bits + 1)) + (int)rnd(1 << rnd(bits + 1));
+    return s > max_size ? max_size : (s < 1 ? 1 : s);
+}
+
+static void rnd_obj(obj_t *o)
+{
+    o->size = rnd_size();
+    o->t_alloc = rnd_time(0, 1);
+    o->t_free = rnd(4) == 0 ? NEVER : rnd_time(o->t_alloc, 1);
+    o->resize = 0;
+    if (rnd(4) == 0) {
+        o->resize = rnd_size();
+        o->t_realloc = rnd_time(o->t_alloc,
+                                o->t_free < 1 ? o->t_free : 1);
+    }
+}
+
+/*
+ * mutate - change one thing about one object
+ */
+static void mutate(obj_t *objs, int n)
+{
+    obj_t *o = &objs[rnd(n)];
+    double end = o->t_free < 1 ? o->t_free : 1;
+    int s;
+
+    switch (rnd(6)) {
+    case 0:     /* a nearby size */
+        s = o->size + (int)rnd(33) - 16;
+        o->size = s < 1 ? 1 : (s > max_size ? max_size : s);
+        break;
+    case 1:     /* any size */
+        o->size = rnd_size();
+        break;
+    case 2:     /* allocate at another time */
+        o->t_alloc = rnd_time(0, o->resize ? o->t_realloc : end);
+        break;
+    case 3:     /* free at another time, or never */
+        if (rnd(8) == 0)
+            o->t_free = NEVER;
+        else
+            o->t_free = rnd_time(o->resize ? o->t_realloc : o->t_alloc, 1);
+        break;
+    case 4:     /* add, change or drop the realloc */
+        if (o->resize && rnd(2) == 0) {
+            o->resize = 0;
+        } else {
+            o->resize = rnd_size();
+            o->t_realloc = rnd_time(o->t_alloc, end);
+        }
+        break;
+    default:    /* a different object */
+        rnd_obj(o);
+        break;
+    }
+}
+
+static int cmp_event(const void *a, const void *b)
+{
+    static const char order[] = "arf";  /* of one object's events */
+    const event_t *x = a, *y = b;
+
+    if (x->t != y->t)
+        return x->t < y->t ? -1 : 1;
+    if (x->obj != y->obj)
+        return x->obj - y->obj;
+    return strchr(order, x->type) - strchr(order, y->type);
+}
+
+/*
+ * build - the trace of a workload, with events in time order
+ */
+static mm_trace_t *build(const obj_t *objs, int n)
+{
+    mm_trace_t *t = calloc(1, sizeof(*t));
+    event_t *ev = malloc(3 * n * sizeof(*ev));
+    int i, ne = 0;
+
+    for (i = 0; i < n; i++) {
+        ev[ne++] = (event_t){ objs[i].t_alloc, i, 'a' };
+        if (objs[i].resize)
+            ev[ne++] = (event_t){ objs[i].t_realloc, i, 'r' };
+        if (objs[i].t_free < 1)
+            ev[ne++] = (event_t){ objs[i].t_free, i, 'f' };
+    }
+    qsort(ev, ne, sizeof(*ev), cmp_event);
+
+    t->weight = 1;
+    t->num_ids = n;
+    t->num_ops = ne;
+    t->ops = malloc(ne * sizeof(*t->ops));
+    for (i = 0; i < ne; i++) {
+        t->ops[i].type = ev[i].type;
+        t->ops[i].index = ev[i].obj;
+        t->ops[i].size = ev[i].type == 'a' ? objs[ev[i].obj].size
+                                           : objs[ev[i].obj].resize;
+    }
+    free(ev);
+    return t;
+}
+
+/*
+ * replay - run the trace once; returns the peak of the live payload
+ *     bytes, or -1 if the allocator ran out of memory. Each op's cycles
+ *     lower cycles[] if time is set.
+ */
+static long replay(const mm_trace_t *t, char **blocks, int *sizes, int time)
+{
+    long live = 0, peak = 0;
+    uint64_t t0, d;
+    int i, id;
+    char *p;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+        return -1;
+    for (i = 0; i < t->num_ops; i++) {
+        id = t->ops[i].index;
+        t0 = __builtin_ia32_rdtsc();
+        switch (t->ops[i].type) {
+        case 'a':
+            p = blocks[id] = mm_malloc(t->ops[i].size);
+            break;
+        case 'r':
+            p = blocks[id] = mm_realloc(blocks[id], t->ops[i].size);
+            break;
+        default:
+            mm_free(blocks[id]);
+            p = (char *)1;
+            break;
+        }
+        d = __builtin_ia32_rdtsc() - t0;
+        if (p == NULL)
+            return -1;
+        if (time && d < cycles[i])
+            cycles[i] = d;
+
+        if (t->ops[i].type == 'f') {
+            live -= sizes[id];
+        } else {
+            live += t->ops[i].size - (t->ops[i].type == 'r' ? sizes[id] : 0);
+            sizes[id] = t->ops[i].size;
+        }
+        if (live > peak)
+            peak = live;
+    }
+    return peak;
+}
+
+/*
+ * badness - how badly the allocator handles the workload: 1 - util, or
+ *     the cycles of the slowest op; -1 if it could not be replayed
+ */
+static double badness(const obj_t *objs, int n)
+{
+    mm_trace_t *t = build(objs, n);
+    char **blocks = calloc(n > 0 ? n : 1, sizeof(char *));
+    int *sizes = calloc(n > 0 ? n : 1, sizeof(int));
+    double score = -1;
+    long peak = 0;
+    int i, r;
+
+    if (lat_mode) {
+        if ((size_t)t->num_ops > ncycles) {
+            ncycles = t->num_ops;
+            cycles = realloc(cycles, ncycles * sizeof(*cycles));
+        }
+        for (i = 0; i < t->num_ops; i++)
+            cycles[i] = UINT64_MAX;
+        for (r = 0; r < LAT_REPS && peak >= 0; r++)
+            peak = replay(t, blocks, sizes, 1);
+        if (peak >= 0)
+            for (score = 0, i = 0; i < t->num_ops; i++)
+                if (cycles[i] > score)
+                    score = cycles[i];
+    } else if ((peak = replay(t, blocks, sizes, 0)) >= 0) {
+        score = 1 - (double)peak / mem_heapsize();
+    }
+
+    free(blocks);
+    free(sizes);
+    mm_trace_free(t);
+    return score;
+}
+
+static int save(const char *path, const obj_t *objs, int n)
+{
+    mm_trace_t *t = build(objs, n);
+    FILE *fp = fopen(path, "w");
+    int ops = t->num_ops;
+
+    if (fp == NULL || mm_trace_write(t, fp) < 0 || fclose(fp) != 0) {
+        perror(path);
+        exit(1);
+    }
+    mm_trace_free(t);
+    return ops;
+}
+
+static void print_score(double bad)
+{
+    if (lat_mode)
+        printf("slowest op %.0f cycles", bad);
+    else
+        printf("util %.1f%%", 100 * (1 - bad));
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: mmsearch [-m util|lat] [-n <objects>] "
+            "[-s <maxsize>] [-i <iters>]\n"
+            "                [-k <restarts>] [-r <seed>] [-o <prefix>]\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int c, i, k, n = 200, iters = 2000, restarts = 3, m, ops;
+    const char *prefix = "worst";
+    obj_t *best, *cand;
+    double bad, cbad;
+    char path[1024];
+
+    while ((c = getopt(argc, argv, "m:n:s:i:k:r:o:")) != -1) {
+        switch (c) {
+        case 'm':
+            if (strcmp(optarg, "lat") == 0)
+                lat_mode = 1;
+            else if (strcmp(optarg, "util") != 0)
+                usage();
+            break;
+        case 'n': n = atoi(optarg); break;
+        case 's': max_size = atoi(optarg); break;
+        case 'i': iters = atoi(optarg); break;
+        case 'k': restarts = atoi(optarg); break;
+        case 'r': rng = strtoull(optarg, NULL, 0) | 1; break;
+        case 'o': prefix = optarg; break;
+        default: usage();
+        }
+    }
+    if (optind != argc || n <= 0 || max_size <= 0 || iters < 0)
+        usage();
+
+    mem_init();
+    best = malloc(n * sizeof(*best));
+    cand = malloc(n * sizeof(*cand));
+
+    for (k = 1; k <= restarts; k++) {
+        do {
+            for (i = 0; i < n; i++)
+                rnd_obj(&best[i]);
+        } while ((bad = badness(best, n)) < 0);
+
+        for (i = 0; i < iters; i++) {
+            memcpy(cand, best, n * sizeof(*cand));
+            mutate(cand, n);
+            if ((cbad = badness(cand, n)) >= bad) {
+                memcpy(best, cand, n * sizeof(*best));
+                bad = cbad;
+            }
+        }
+        snprintf(path, sizeof(path), "%s%d.rep", prefix, k);
+        ops = save(path, best, n);
+        printf("%s: ", path);
+        print_score(bad);
+        printf(", %d objects, %d ops\n", n, ops);
+
+        /* Drop objects that do not matter to the score */
+        memcpy(cand, best, n * sizeof(*cand));
+        m = n;
+        for (i = m - 1; i >= 0 && m > 1; i--) {
+            obj_t o = cand[i];
+
+            cand[i] = cand[m - 1];
+            if ((cbad = badness(cand, m - 1)) >= bad * (1 - MIN_SLACK)) {
+                m--;
+            } else {
+                cand[m - 1] = cand[i];
+                cand[i] = o;
+            }
+        }
+        snprintf(path, sizeof(path), "%s%d-min.rep", prefix, k);
+        ops = save(path, cand, m);
+        printf("%s: ", path);
+        print_score(badness(cand, m));
+        printf(", %d objects, %d ops\n", m, ops);
+    }
+    return 0;
+}
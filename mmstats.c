@@ -0,0 +1,154 @@
+/*
+ * mmstats.c - publish allocator counters in a shared-memory page
+ *
+ * Writers follow the seqlock protocol: bump seq to an odd value, copy
+ * the counters, bump seq to the next even value. A reader retries until
+ * it sees the same even seq before and after its copy. There is only
+ * one writer (the allocator), so no locking is needed on this side.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "mmstats.h"
+#include "memlib.h"
+
+mm_stats_t mm_stats;
+__thread mm_stats_thread_t *mm_stats_slot;
+int mm_stats_countdown = STATS_PERIOD;
+
+static mm_stats_t *page;        /* shared page, NULL if not published */
+static char page_name[64];
+static int initialized = 0;
+static pthread_key_t slot_key;  /* gives a slot back at thread exit */
+static pthread_once_t slot_once = PTHREAD_ONCE_INIT;
+
+/*
+ * stats_unlink - remove the shared page when the process exits
+ */
+static void stats_unlink(void)
+{
+    shm_unlink(page_name);
+}
+
+/*
+ * stats_map - create and map /mm_stats.<pid>
+ */
+static void stats_map(void)
+{
+    int fd;
+
+    snprintf(page_name, sizeof(page_name), STATS_NAME, (int)getpid());
+    if ((fd = shm_open(page_name, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+        return;
+    if (ftruncate(fd, sizeof(mm_stats_t)) < 0) {
+        close(fd);
+        shm_unlink(page_name);
+        return;
+    }
+    page = mmap(NULL, sizeof(mm_stats_t), PROT_READ | PROT_WRITE,
+                MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        page = NULL;
+        shm_unlink(page_name);
+        return;
+    }
+    page->magic = STATS_MAGIC;
+    page->version = STATS_VERSION;
+    page->pid = (int32_t)getpid();
+    atexit(stats_unlink);
+}
+
+/*
+ * mm_stats_init - reset the gauges for a fresh heap; the first call also
+ *     creates the shared page if MM_STATS is set in the environment
+ */
+void mm_stats_init(void)
+{
+    int i;
+
+    if (!initialized) {
+        initialized = 1;
+        if (getenv("MM_STATS") != NULL)
+            stats_map();
+    }
+
+    mm_stats.live_bytes = 0;
+    mm_stats.live_blocks = 0;
+    for (i = 0; i < STATS_NTHREADS; i++) {
+        memset(mm_stats.thread[i].tag_bytes, 0,
+               sizeof(mm_stats.thread[i].tag_bytes));
+        memset(mm_stats.thread[i].tag_blocks, 0,
+               sizeof(mm_stats.thread[i].tag_blocks));
+    }
+    memset(mm_stats.bucket_free, 0, sizeof(mm_stats.bucket_free));
+    mm_stats_publish();
+}
+
+/*
+ * slot_release - key destructor: give an exiting thread's slot back
+ */
+static void slot_release(void *slot)
+{
+    mm_stats_slot = NULL;
+    __atomic_store_n(&((mm_stats_thread_t *)slot)->tid, 0, __ATOMIC_RELEASE);
+}
+
+static void slot_key_create(void)
+{
+    pthread_key_create(&slot_key, slot_release);
+}
+
+/*
+ * mm_stats_claim - find a per-thread slot for the calling thread
+ */
+mm_stats_thread_t *mm_stats_claim(void)
+{
+    uint32_t tid = (uint32_t)syscall(SYS_gettid);
+    uint32_t expected;
+    int i;
+
+    pthread_once(&slot_once, slot_key_create);
+    for (i = 0; i < STATS_NTHREADS - 1; i++) {
+        expected = 0;
+        if (mm_stats.thread[i].tid == tid ||
+            __atomic_compare_exchange_n(&mm_stats.thread[i].tid, &expected,
+                                        tid, 0, __ATOMIC_ACQUIRE,
+                                        __ATOMIC_RELAXED)) {
+            pthread_setspecific(slot_key, &mm_stats.thread[i]);
+            return mm_stats_slot = &mm_stats.thread[i];
+        }
+    }
+    mm_stats.thread[i].tid = (uint32_t)-1; /* shared overflow slot */
+    return mm_stats_slot = &mm_stats.thread[i];
+}
+
+/*
+ * mm_stats_publish - copy the private counters to the shared page
+ */
+void mm_stats_publish(void)
+{
+    const size_t start = offsetof(mm_stats_t, heap_size);
+    uint32_t seq;
+
+    mm_stats_countdown = STATS_PERIOD;
+    if (page == NULL)
+        return;
+
+    mm_stats.heap_size = mem_heapsize();
+    mm_stats.npublish++;
+
+    seq = page->seq;
+    __atomic_store_n(&page->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy((char *)page + start, (char *)&mm_stats + start,
+           sizeof(mm_stats_t) - start);
+    __atomic_store_n(&page->seq, seq + 2, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,95 @@
+/*
+ * mmstats.h - allocator counters and the shared-memory stats page
+ *
+ * The allocator keeps its counters in mm_stats, a private struct that
+ * is only ever touched by the allocator itself. Every STATS_PERIOD
+ * operations (and on mm_init) the whole struct is copied into a
+ * shared-memory page under a seqlock, where the mm_top tool can read it
+ * from another process without stopping this one.
+ *
+ * The page is created only when the MM_STATS environment variable is
+ * set when mm_init first runs; it is named /mm_stats.<pid> (i.e.
+ * /dev/shm/mm_stats.<pid> on Linux) and removed at exit.
+ */
+#ifndef __MMSTATS_H_
+#define __MMSTATS_H_
+
+#include <stdint.h>
+
+#define STATS_MAGIC    0x54534d4d /* "MMST" */
+#define STATS_VERSION  3
+#define STATS_NAME     "/mm_stats.%d"  /* shm_open name, %d = pid */
+#define STATS_PERIOD   4096            /* ops between publications */
+#define STATS_NBUCKETS 256             /* free list buckets tracked */
+#define STATS_NTHREADS 16              /* threads broken down individually */
+#define STATS_NHOT     8               /* dedicated hot-size bins */
+#define STATS_NTAGS    16              /* allocation tags (mm_malloc_tagged) */
+
+/* Per-thread counters. A thread's slot is given back when it exits and
+   taken over, counters and all, by the next new thread; threads past
+   STATS_NTHREADS live ones share the last slot, which is updated
+   atomically. A block freed by another thread than the one that
+   allocated it is
+   subtracted from the freeing thread's tag counters, so only their sum
+   over all slots is meaningful. */
+typedef struct {
+    uint32_t tid;           /* 0 if the slot is unused */
+    uint32_t pad;
+    uint64_t nmalloc;
+    uint64_t nfree;
+    uint64_t malloc_bytes;  /* bytes requested */
+    int64_t tag_bytes[STATS_NTAGS];     /* live bytes in blocks, by tag */
+    int64_t tag_blocks[STATS_NTAGS];
+} mm_stats_thread_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seq;           /* seqlock: odd while the page is written */
+    int32_t  pid;
+
+    /* gauges, reset by mm_init */
+    uint64_t heap_size;     /* bytes obtained with mem_sbrk */
+    uint64_t live_bytes;    /* bytes in allocated blocks */
+    uint64_t live_blocks;
+    uint32_t nbuckets;      /* entries of bucket_free in use */
+    uint32_t pad;
+    uint64_t bucket_free[STATS_NBUCKETS]; /* free bytes per free list */
+    uint32_t hot_size[STATS_NHOT];  /* block size of each hot bin, or 0 */
+
+    /* monotonic counters */
+    uint64_t nmalloc;
+    uint64_t nfree;
+    uint64_t nrealloc;
+    uint64_t nextend;       /* heap extensions */
+    uint64_t extend_bytes;
+    uint64_t npurge;        /* memory returned to the system */
+    uint64_t purge_bytes;
+    uint64_t npublish;      /* times this page was updated */
+
+    mm_stats_thread_t thread[STATS_NTHREADS];
+} mm_stats_t;
+
+/* The allocator's private counters, and the calling thread's slot */
+extern mm_stats_t mm_stats;
+extern __thread mm_stats_thread_t *mm_stats_slot;
+extern int mm_stats_countdown;
+
+void mm_stats_init(void);
+void mm_stats_publish(void);
+mm_stats_thread_t *mm_stats_claim(void);
+
+#define STAT_ADD(field, n) (mm_stats.field += (n))
+#define STAT_SUB(field, n) (mm_stats.field -= (n))
+#define STAT_THREAD() (mm_stats_slot ? mm_stats_slot : mm_stats_claim())
+#define STAT_THREAD_ADD(field, n) do { \
+        mm_stats_thread_t *th_ = STAT_THREAD(); \
+        if (th_ == &mm_stats.thread[STATS_NTHREADS - 1]) \
+            __atomic_fetch_add(&th_->field, (n), __ATOMIC_RELAXED); \
+        else \
+            th_->field += (n); \
+    } while (0)
+#define STAT_TICK() \
+    do { if (--mm_stats_countdown <= 0) mm_stats_publish(); } while (0)
+
+#endif /* __MMSTATS_H_ */
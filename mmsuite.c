@@ -0,0 +1,261 @@
+/*
+ * mmsuite.c - suite manifests and the ranking of builds
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "mmsuite.h"
+
+#define MAXRESULTS 64
+#define LABELLEN 64
+
+static const char *objectives[] = { "throughput", "util", "p99" };
+
+/*
+ * parse_bytes - a number with an optional K, M or G suffix
+ */
+static double parse_bytes(const char *s)
+{
+    char *end;
+    double n = strtod(s, &end);
+
+    switch (toupper((unsigned char)*end)) {
+    case 'K': return n * (1 << 10);
+    case 'M': return n * (1 << 20);
+    case 'G': return n * (1 << 30);
+    }
+    return n;
+}
+
+int mm_suite_read(const char *path, mm_suite_t *suite)
+{
+    FILE *fp = fopen(path, "r");
+    char line[1024], *word, *arg, *arg2;
+    int lineno = 0, i;
+
+    if (fp == NULL) {
+        perror(path);
+        return -1;
+    }
+    memset(suite, 0, sizeof(*suite));
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        lineno++;
+        if ((word = strchr(line, '#')) != NULL)
+            *word = '\0';
+        if ((word = strtok(line, " \t\r\n")) == NULL)
+            continue;
+        arg = strtok(NULL, " \t\r\n");
+        arg2 = strtok(NULL, " \t\r\n");
+        if (arg == NULL)
+            goto bad;
+
+        if (strcmp(word, "trace") == 0) {
+            if (arg2 == NULL || suite->ntraces == SUITE_MAXTRACES ||
+                atof(arg2) <= 0)
+                goto bad;
+            suite->traces[suite->ntraces] = strdup(arg);
+            suite->weight[suite->ntraces++] = atof(arg2);
+        } else if (strcmp(word, "objective") == 0) {
+            for (i = 0; i < 3 && strcmp(arg, objectives[i]) != 0; i++)
+                ;
+            if (i == 3)
+                goto bad;
+            suite->objective = i;
+        } else if (strcmp(word, "floor") == 0 && arg2 != NULL) {
+            if (strcmp(arg, "util") == 0)
+                suite->util_floor = atof(arg2);
+            else if (strcmp(arg, "throughput") == 0)
+                suite->tput_floor = atof(arg2);
+            else
+                goto bad;
+        } else if (strcmp(word, "cap") == 0 && arg2 != NULL) {
+            if (strcmp(arg, "p99") == 0)
+                suite->p99_cap = atof(arg2);
+            else if (strcmp(arg, "heap") == 0)
+                suite->heap_cap = parse_bytes(arg2);
+            else
+                goto bad;
+        } else if (strcmp(word, "results") == 0) {
+            suite->results = strdup(arg);
+        } else {
+            goto bad;
+        }
+        continue;
+    bad:
+        fprintf(stderr, "%s:%d: bad directive\n", path, lineno);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    if (suite->ntraces == 0) {
+        fprintf(stderr, "%s: no traces\n", path);
+        return -1;
+    }
+    suite->traces[suite->ntraces] = NULL;
+    return 0;
+}
+
+/*
+ * weighted_p99 - the op latency below which 99% of the weighted ops
+ *     fall, where each op of trace i weighs weight[i] / ops[i]: a k-way
+ *     merge of the sorted latencies
+ */
+static double weighted_p99(const mm_suite_t *suite, const mm_suite_trace_t *t)
+{
+    int *pos = calloc(suite->ntraces, sizeof(int));
+    double total = 0, sum = 0;
+    uint32_t lat = 0;
+    int i, best;
+
+    for (i = 0; i < suite->ntraces; i++)
+        if (t[i].valid && t[i].ops > 0)
+            total += suite->weight[i];
+    while (sum < 0.99 * total) {
+        for (best = -1, i = 0; i < suite->ntraces; i++)
+            if (t[i].valid && pos[i] < t[i].ops &&
+                (best < 0 || t[i].lat[pos[i]] < t[best].lat[pos[best]]))
+                best = i;
+        if (best < 0)
+            break;
+        lat = t[best].lat[pos[best]++];
+        sum += suite->weight[best] / t[best].ops;
+    }
+    free(pos);
+    return lat;
+}
+
+void mm_suite_score(const mm_suite_t *suite, const mm_suite_trace_t *t,
+                    mm_suite_result_t *r)
+{
+    double w = 0, util = 0, secs_per_op = 0;
+    int i;
+
+    memset(r, 0, sizeof(*r));
+    r->feasible = 1;
+    for (i = 0; i < suite->ntraces; i++) {
+        if (!t[i].valid) {
+            r->feasible = 0;
+            continue;
+        }
+        w += suite->weight[i];
+        util += suite->weight[i] * t[i].util;
+        secs_per_op += suite->weight[i] * t[i].secs / t[i].ops;
+        if (t[i].heap > r->heap)
+            r->heap = t[i].heap;
+    }
+    if (w > 0) {
+        r->util = util / w;
+        r->kops = secs_per_op > 0 ? w / secs_per_op / 1e3 : 0;
+        r->p99 = weighted_p99(suite, t);
+    }
+
+    if ((suite->util_floor && r->util < suite->util_floor) ||
+        (suite->tput_floor && r->kops < suite->tput_floor) ||
+        (suite->p99_cap && r->p99 > suite->p99_cap) ||
+        (suite->heap_cap && r->heap > suite->heap_cap))
+        r->feasible = 0;
+    r->objective = suite->objective == SUITE_UTIL ? r->util :
+                   suite->objective == SUITE_P99 ? r->p99 : r->kops;
+}
+
+/*
+ * check - one line of the summary: a metric and its constraint
+ */
+static void check(const char *name, const char *fmt, double v,
+                  const char *rel, double bound)
+{
+    printf("  %-12s", name);
+    printf(fmt, v);
+    if (bound)
+        printf("  (%s %.10g: %s)", rel, bound,
+               (*rel == '>' ? v >= bound : v <= bound) ? "ok" : "FAILS");
+    printf("\n");
+}
+
+void mm_suite_print(const mm_suite_t *suite, const mm_suite_result_t *r)
+{
+    printf("Suite (%d traces), objective %s:\n", suite->ntraces,
+           objectives[suite->objective]);
+    check("util", "%10.1f%%", 100 * r->util, ">=", 100 * suite->util_floor);
+    check("Kops", "%10.0f ", r->kops, ">=", suite->tput_floor);
+    check("p99 cycles", "%10.0f ", r->p99, "<=", suite->p99_cap);
+    check("heap bytes", "%10.0f ", r->heap, "<=", suite->heap_cap);
+    printf("  => %s\n", r->feasible ? "feasible" : "INFEASIBLE");
+}
+
+typedef struct {
+    char label[LABELLEN];
+    int feasible;
+    double objective, util, kops, p99, heap;
+} entry_t;
+
+/*
+ * better - qsort order: feasible builds first, then by objective
+ */
+static int objective_kind;
+static int better(const void *a, const void *b)
+{
+    const entry_t *x = a, *y = b;
+    double d;
+
+    if (x->feasible != y->feasible)
+        return y->feasible - x->feasible;
+    d = y->objective - x->objective;
+    if (objective_kind == SUITE_P99)
+        d = -d;
+    return d > 0 ? 1 : (d < 0 ? -1 : 0);
+}
+
+void mm_suite_rank(const mm_suite_t *suite, const char *label,
+                   const mm_suite_result_t *r)
+{
+    entry_t e[MAXRESULTS + 1];
+    int i, n = 0;
+    FILE *fp;
+
+    if (suite->results == NULL)
+        return;
+
+    /* Read the other builds' results, then rewrite the file with ours */
+    if ((fp = fopen(suite->results, "r")) != NULL) {
+        while (n < MAXRESULTS &&
+               fscanf(fp, "%63s %d %lf %lf %lf %lf %lf", e[n].label,
+                      &e[n].feasible, &e[n].objective, &e[n].util,
+                      &e[n].kops, &e[n].p99, &e[n].heap) == 7)
+            if (strcmp(e[n].label, label) != 0)
+                n++;
+        fclose(fp);
+    }
+    snprintf(e[n].label, LABELLEN, "%s", label);
+    e[n].feasible = r->feasible;
+    e[n].objective = r->objective;
+    e[n].util = r->util;
+    e[n].kops = r->kops;
+    e[n].p99 = r->p99;
+    e[n].heap = r->heap;
+    n++;
+
+    if ((fp = fopen(suite->results, "w")) == NULL) {
+        perror(suite->results);
+        return;
+    }
+    for (i = 0; i < n; i++)
+        fprintf(fp, "%s %d %.10g %.10g %.10g %.10g %.10g\n", e[i].label,
+                e[i].feasible, e[i].objective, e[i].util, e[i].kops,
+                e[i].p99, e[i].heap);
+    fclose(fp);
+
+    objective_kind = suite->objective;
+    qsort(e, n, sizeof(entry_t), better);
+    printf("Ranking by %s (%s):\n", objectives[suite->objective],
+           suite->results);
+    printf("  %-4s %-20s %8s %10s %10s %12s\n", "", "build", "util", "Kops",
+           "p99", "heap");
+    for (i = 0; i < n; i++)
+        printf("  %-4s %-20s %7.1f%% %10.0f %10.0f %12.0f%s\n",
+               e[i].feasible ? "" : "(x)", e[i].label, 100 * e[i].util,
+               e[i].kops, e[i].p99, e[i].heap,
+               strcmp(e[i].label, label) == 0 ? "  <-" : "");
+}
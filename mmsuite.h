@@ -0,0 +1,82 @@
+/*
+ * mmsuite.h - suite manifests: production-weighted scoring of a build
+ *
+ * The perf index weighs every trace the same and mixes utilization and
+ * throughput with fixed grading constants. A manifest, given with
+ * "mdriver -M <file>", instead lists the traces to run with the share
+ * of production ops each one stands for, and the metric the build is
+ * judged on. One directive per line, '#' starts a comment:
+ *
+ *     trace <file> <weight>     run file (in the trace directory)
+ *     objective throughput|util|p99
+ *     floor util <fraction>     constraints the build must meet
+ *     floor throughput <Kops>
+ *     cap p99 <cycles>
+ *     cap heap <bytes>[K|M|G]
+ *     results <file>            where builds are ranked
+ *
+ * The weighted metrics are: utilization averaged by weight, throughput
+ * from the weighted mean time per op, the 99th percentile of op latency
+ * over the weighted mix of all traces' ops, and the largest heap of any
+ * trace. A build that meets every constraint is ranked by its objective
+ * above every build that does not.
+ */
+#ifndef __MMSUITE_H_
+#define __MMSUITE_H_
+
+#include <stdint.h>
+
+#define SUITE_MAXTRACES 256
+
+/* Objectives */
+#define SUITE_THROUGHPUT 0
+#define SUITE_UTIL       1
+#define SUITE_P99        2
+
+typedef struct {
+    int objective;
+    double util_floor;      /* 0 if none */
+    double tput_floor;      /* Kops, 0 if none */
+    double p99_cap;         /* cycles, 0 if none */
+    double heap_cap;        /* bytes, 0 if none */
+    char *results;          /* NULL if none */
+    int ntraces;
+    char *traces[SUITE_MAXTRACES + 1];  /* NULL-terminated */
+    double weight[SUITE_MAXTRACES];
+} mm_suite_t;
+
+/* What the driver measured on one trace of the suite */
+typedef struct {
+    int valid;
+    double ops;
+    double secs;
+    double util;
+    double heap;            /* bytes */
+    uint32_t *lat;          /* cycles of each op, sorted */
+} mm_suite_trace_t;
+
+typedef struct {
+    double util;
+    double kops;
+    double p99;
+    double heap;
+    double objective;       /* one of the above */
+    int feasible;           /* all traces valid, all constraints met */
+} mm_suite_result_t;
+
+/* Read a manifest; prints why and returns -1 if it is malformed */
+int mm_suite_read(const char *path, mm_suite_t *suite);
+
+/* Weigh the per-trace measurements into r */
+void mm_suite_score(const mm_suite_t *suite, const mm_suite_trace_t *t,
+                    mm_suite_result_t *r);
+
+/* Print r against the constraints */
+void mm_suite_print(const mm_suite_t *suite, const mm_suite_result_t *r);
+
+/* Record r under label in the results file, if any, and print the
+   ranking of all builds recorded there */
+void mm_suite_rank(const mm_suite_t *suite, const char *label,
+                   const mm_suite_result_t *r);
+
+#endif /* __MMSUITE_H_ */
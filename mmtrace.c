@@ -0,0 +1,96 @@
+/*
+ * mmtrace.c - read and write .rep trace files
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mmtrace.h"
+
+/*
+ * mm_trace_read - read the trace file at path
+ */
+mm_trace_t *mm_trace_read(const char *path)
+{
+    FILE *fp;
+    mm_trace_t *t;
+    mm_traceop_t *op;
+    char type[2];
+    int i, size = 0;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+        perror(path);
+        return NULL;
+    }
+    if ((t = calloc(1, sizeof(*t))) == NULL)
+        goto fail;
+    if (fscanf(fp, "%d %d %d %d", &t->weight, &t->num_ids, &t->num_ops,
+               &t->ignore_ranges) != 4 || t->num_ids < 0 || t->num_ops < 0) {
+        fprintf(stderr, "%s: bad header\n", path);
+        goto fail;
+    }
+    if ((t->ops = calloc(t->num_ops + 1, sizeof(*t->ops))) == NULL)
+        goto fail;
+
+    for (i = 0; i < t->num_ops; i++) {
+        op = &t->ops[i];
+        if (fscanf(fp, "%1s", type) != 1) {
+            fprintf(stderr, "%s: %d ops, header says %d\n", path, i,
+                    t->num_ops);
+            goto fail;
+        }
+        op->type = type[0];
+        if ((op->type != 'a' && op->type != 'r' && op->type != 'f') ||
+            fscanf(fp, "%d", &op->index) != 1) {
+            fprintf(stderr, "%s: bad op %d\n", path, i + 1);
+            goto fail;
+        }
+        /* like the driver, take a missing size to be the last one read */
+        if (op->type != 'f' && fscanf(fp, "%d", &size) != 1 && ferror(fp))
+            goto fail;
+        op->size = op->type != 'f' ? size : 0;
+        if (op->index >= t->num_ids ||
+            (op->index < 0 && !(op->type == 'f' && op->index == -1))) {
+            fprintf(stderr, "%s: op %d: id %d out of range\n", path, i + 1,
+                    op->index);
+            goto fail;
+        }
+    }
+    fclose(fp);
+    return t;
+
+fail:
+    fclose(fp);
+    mm_trace_free(t);
+    return NULL;
+}
+
+/*
+ * mm_trace_write - write trace to fp
+ */
+int mm_trace_write(const mm_trace_t *t, FILE *fp)
+{
+    const mm_traceop_t *op;
+    int i;
+
+    fprintf(fp, "%d\n%d\n%d\n%d\n", t->weight, t->num_ids, t->num_ops,
+            t->ignore_ranges);
+    for (i = 0; i < t->num_ops; i++) {
+        op = &t->ops[i];
+        if (op->type == 'f')
+            fprintf(fp, "f %d\n", op->index);
+        else
+            fprintf(fp, "%c %d %d\n", op->type, op->index, op->size);
+    }
+    return ferror(fp) ? -1 : 0;
+}
+
+/*
+ * mm_trace_free - free a trace returned by mm_trace_read
+ */
+void mm_trace_free(mm_trace_t *t)
+{
+    if (t != NULL) {
+        free(t->ops);
+        free(t);
+    }
+}
@@ -0,0 +1,37 @@
+/*
+ * mmtrace.h - read and write .rep trace files (for the trace tools)
+ *
+ * A trace file starts with four numbers: weight, number of block ids,
+ * number of ops and an ignore-ranges flag (0 or 1). Then come the ops,
+ * one per line: "a <id> <size>", "r <id> <size>" or "f <id>"; a missing
+ * size repeats the last one, as it does in the driver. The driver has its
+ * own reader; this one is shared by the standalone tools.
+ */
+#ifndef __MMTRACE_H_
+#define __MMTRACE_H_
+
+#include <stdio.h>
+
+typedef struct {
+    char type;              /* 'a', 'r' or 'f' */
+    int index;              /* block id; -1 frees NULL */
+    int size;               /* bytes for 'a' and 'r' */
+} mm_traceop_t;
+
+typedef struct {
+    int weight;
+    int num_ids;
+    int num_ops;
+    int ignore_ranges;
+    mm_traceop_t *ops;
+} mm_trace_t;
+
+/* Read a trace; prints why and returns NULL if it is malformed */
+mm_trace_t *mm_trace_read(const char *path);
+
+/* Write a trace in the same format; returns -1 on a write error */
+int mm_trace_write(const mm_trace_t *trace, FILE *fp);
+
+void mm_trace_free(mm_trace_t *trace);
+
+#endif /* __MMTRACE_H_ */
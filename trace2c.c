@@ -0,0 +1,84 @@
+/*
+ * trace2c.c - compile a .rep trace into C (see ctrace.h)
+ *
+ * usage: trace2c [-n <ops>] <tracefile> > ctrace.c
+ *     -n   ops per generated function (default 1000)
+ *
+ * The output defines mm_ctrace. Allocation failures are not checked:
+ * the driver validates the trace with its interpreter first.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "mmtrace.h"
+
+#define DEFAULT_CHUNK 1000
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: trace2c [-n <ops>] <tracefile>\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    mm_trace_t *t;
+    mm_traceop_t *op;
+    int c, i, chunk = DEFAULT_CHUNK, nfuncs;
+
+    while ((c = getopt(argc, argv, "n:")) != -1) {
+        switch (c) {
+        case 'n':
+            if ((chunk = atoi(optarg)) <= 0)
+                usage();
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc - 1)
+        usage();
+    if ((t = mm_trace_read(argv[optind])) == NULL)
+        return 1;
+    nfuncs = (t->num_ops + chunk - 1) / chunk;
+
+    printf("/* Compiled from %s by trace2c; do not edit */\n", argv[optind]);
+    printf("#include <stddef.h>\n#include <string.h>\n\n"
+           "#include \"mm.h\"\n#include \"ctrace.h\"\n\n");
+    printf("static char *s[%d];\n", t->num_ids > 0 ? t->num_ids : 1);
+    printf("\nstatic void reset(void)\n{\n    memset(s, 0, sizeof(s));\n}\n");
+
+    for (i = 0; i < t->num_ops; i++) {
+        op = &t->ops[i];
+        if (i % chunk == 0)
+            printf("%s\nstatic void f%d(void)\n{\n", i ? "}\n" : "",
+                   i / chunk);
+        switch (op->type) {
+        case 'a':
+            printf("    s[%d] = mm_malloc(%d);\n", op->index, op->size);
+            break;
+        case 'r':
+            printf("    s[%d] = mm_realloc(s[%d], %d);\n", op->index,
+                   op->index, op->size);
+            break;
+        case 'f':
+            if (op->index < 0)
+                printf("    mm_free(NULL);\n");
+            else
+                printf("    mm_free(s[%d]);\n", op->index);
+            break;
+        }
+    }
+    if (t->num_ops > 0)
+        printf("}\n");
+
+    printf("\nstatic void (*const funcs[])(void) = {");
+    for (i = 0; i < nfuncs; i++)
+        printf("%s f%d,", i % 8 ? "" : "\n   ", i);
+    printf("%s\n};\n\n", nfuncs ? "" : " NULL");
+    printf("const ctrace_t mm_ctrace = { \"%s\", %d, %d, funcs, reset };\n",
+           argv[optind], t->num_ops, nfuncs);
+    mm_trace_free(t);
+    return 0;
+}
@@ -0,0 +1,551 @@
+/*
+ * tracesample.c - shrink a trace while keeping its character
+ *
+ * usage: tracesample [-n <ops> | -p <fraction>] [-q] <in.rep> <out.rep>
+ *     -n   about this many ops in the sample (default 5000)
+ *     -p   keep this fraction of the blocks instead
+ *     -q   do not print the fidelity report
+ *
+ * Truncating a trace keeps only its start-up phase. Instead, the sample
+ * keeps a fraction p of the blocks with all their ops, in their original
+ * order. Blocks are grouped into strata by request size (log2), lifetime
+ * in ops (log2) and whether they are reallocated, and each stratum is
+ * thinned systematically in order of allocation, so that the size and
+ * lifetime histograms and the live-bytes curve over time are kept, with
+ * live bytes scaled by p.
+ *
+ * That needs many blocks live at a time. When thinning would leave
+ * fewer than MIN_LIVE of them at the peak, the sample is made of evenly
+ * spaced windows of the trace instead, one of them around the peak of
+ * live bytes: at most MAX_WINDOWS, each at least four median lifetimes
+ * long. Each window starts by allocating the blocks live at its start
+ * and ends by freeing those still live.
+ *
+ * The report compares the two traces: the total variation distance of
+ * the size and lifetime histograms (0 = same, 1 = disjoint; lifetimes
+ * of thinned blocks are scaled back by 1/p), the largest gap between
+ * the live bytes after each op of the sample and after the op it came
+ * from, both divided by their trace's peak, and the utilization that the
+ * allocator linked into this tool gets on both under each configuration
+ * of CONFIGS.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "mmtrace.h"
+
+#define DEFAULT_OPS 5000
+#define NBUCKETS 40         /* log2 buckets of sizes and lifetimes */
+#define MIN_LIVE 50         /* live blocks needed at the peak for thinning */
+#define MAX_WINDOWS 10
+
+/* Allocator configurations for the utilization comparison, as an
+   environment assignment read by mm_init ("" for the defaults) */
+static const char *configs[] = {
+    "", "MM_SLAB=64", "MM_PAGES=4096", "MM_NOSHARE=1", "MM_COLOR=1024",
+};
+#define NCONFIGS (int)(sizeof(configs) / sizeof(configs[0]))
+
+/* For each op of the sample, the op of the trace it was taken from, or
+   -1 for the allocations and frees around a window */
+static int *origin;
+
+/* What is known about each block id */
+typedef struct {
+    int first;              /* op that allocates it */
+    int last;               /* op that frees it, or num_ops */
+    int size;               /* first request */
+    int realloced;
+    int stratum;
+    int keep;
+    int newid;
+} block_t;
+
+static int log2_bucket(long n)
+{
+    int b = 0;
+
+    while (n > 1 && b < NBUCKETS - 1) {
+        n >>= 1;
+        b++;
+    }
+    return b;
+}
+
+/*
+ * scan - one block per allocation (or realloc of a free id), in order;
+ *     opblock[i] gets the block of op i, or -1 for free(NULL)
+ */
+static block_t *scan(const mm_trace_t *t, int *opblock, int *nblocks)
+{
+    int i, id, n = 0, cap = t->num_ids + 16;
+    int *cur = malloc((t->num_ids + 1) * sizeof(int));
+    block_t *b = calloc(cap, sizeof(block_t));
+
+    for (i = 0; i < t->num_ids; i++)
+        cur[i] = -1;
+    for (i = 0; i < t->num_ops; i++) {
+        id = t->ops[i].index;
+        if (id < 0) {               /* free(NULL) */
+            opblock[i] = -1;
+            continue;
+        }
+        if (t->ops[i].type == 'a' ||
+            (t->ops[i].type == 'r' && cur[id] < 0)) {
+            if (n == cap)
+                b = realloc(b, (cap *= 2) * sizeof(block_t));
+            memset(&b[n], 0, sizeof(block_t));
+            b[n].first = i;
+            b[n].last = t->num_ops;
+            b[n].size = t->ops[i].size;
+            cur[id] = n++;
+        }
+        opblock[i] = cur[id];
+        if (cur[id] < 0)
+            continue;
+        if (t->ops[i].type == 'r')
+            b[cur[id]].realloced = 1;
+        else if (t->ops[i].type == 'f')
+            b[cur[id]].last = i;
+    }
+    free(cur);
+    *nblocks = n;
+    return b;
+}
+
+/*
+ * sample_blocks - the trace of the kept blocks, with ids renumbered
+ *     densely
+ */
+static mm_trace_t *sample_blocks(const mm_trace_t *t, block_t *b, int nblocks,
+                          const int *opblock, double p)
+{
+    mm_trace_t *s = calloc(1, sizeof(*s));
+    double *acc = calloc(2 * NBUCKETS * NBUCKETS, sizeof(double));
+    int *idfree = malloc((nblocks + 1) * sizeof(int));
+    int i, k, nfree = 0, nids = 0;
+    double nullacc = 0.5;
+
+    /* Starting at one keeps the first block of every stratum, so rare
+       sizes (often the large blocks that decide the heap size) stay */
+    for (k = 0; k < 2 * NBUCKETS * NBUCKETS; k++)
+        acc[k] = 1;
+    for (k = 0; k < nblocks; k++) {
+        b[k].stratum = (log2_bucket(b[k].size) * NBUCKETS +
+                        log2_bucket(b[k].last - b[k].first)) * 2 +
+                       b[k].realloced;
+        acc[b[k].stratum] += p;
+        if ((b[k].keep = acc[b[k].stratum] >= 1))
+            acc[b[k].stratum] -= 1;
+    }
+
+    s->weight = t->weight;
+    s->ignore_ranges = t->ignore_ranges;
+    s->ops = malloc(t->num_ops * sizeof(*s->ops));
+    origin = malloc(t->num_ops * sizeof(int));
+    for (i = 0; i < t->num_ops; i++) {
+        mm_traceop_t op = t->ops[i];
+
+        if (opblock[i] < 0) {
+            if (op.index >= 0 || (nullacc += p) < 1)
+                continue;
+            nullacc -= 1;
+        } else {
+            block_t *bl = &b[opblock[i]];
+
+            if (!bl->keep)
+                continue;
+            /* Reuse ids of freed blocks, as programs reuse pointers,
+               except for realloc(NULL): the driver would pass it the
+               freed block */
+            if (i == bl->first)
+                bl->newid = nfree > 0 && op.type == 'a' ? idfree[--nfree]
+                                                        : nids++;
+            op.index = bl->newid;
+            if (op.type == 'f')
+                idfree[nfree++] = bl->newid;
+        }
+        origin[s->num_ops] = i;
+        s->ops[s->num_ops++] = op;
+    }
+    s->num_ids = nids;
+    free(acc);
+    free(idfree);
+    return s;
+}
+
+/*
+ * peak_live - the most blocks live at once; *peak_op gets the op after
+ *     which the most bytes are live
+ */
+static int peak_live(const mm_trace_t *t, int *peak_op)
+{
+    int *sizes = calloc(t->num_ids + 1, sizeof(int));
+    char *live = calloc(t->num_ids + 1, 1);
+    long bytes = 0, peak = -1;
+    int i, id, n = 0, most = 0;
+
+    for (i = 0; i < t->num_ops; i++) {
+        if ((id = t->ops[i].index) < 0)
+            continue;
+        bytes -= sizes[id];
+        n -= live[id];
+        live[id] = t->ops[i].type != 'f';
+        sizes[id] = live[id] ? t->ops[i].size : 0;
+        bytes += sizes[id];
+        n += live[id];
+        if (n > most)
+            most = n;
+        if (bytes > peak) {
+            peak = bytes;
+            *peak_op = i;
+        }
+    }
+    free(sizes);
+    free(live);
+    return most;
+}
+
+/*
+ * sample_windows - nw windows of about p * num_ops ops in all, each in
+ *     its own 1/nw of the trace; the one in the part holding peak_op is
+ *     moved over it. Ids are renumbered densely.
+ */
+static mm_trace_t *sample_windows(const mm_trace_t *t, double p, int nw,
+                                  int peak_op)
+{
+    mm_trace_t *s = calloc(1, sizeof(*s));
+    int *sizes = calloc(t->num_ids + 1, sizeof(int));   /* size + 1 if live */
+    int *map = malloc((t->num_ids + 1) * sizeof(int));
+    int *idfree = malloc((t->num_ids + 1) * sizeof(int));
+    int len = p * t->num_ops / nw, cap = 2 * t->num_ops + 16;
+    int i, id, w, start, lo, hi, nfree = 0, nids = 0;
+    mm_traceop_t op;
+
+    if (len < 1)
+        len = 1;
+    for (id = 0; id < t->num_ids; id++)
+        map[id] = -1;
+    s->weight = t->weight;
+    s->ignore_ranges = t->ignore_ranges;
+    s->ops = malloc(cap * sizeof(*s->ops));
+    origin = malloc(cap * sizeof(int));
+
+#define EMIT(type_, id_, size_, from) do {                              \
+        if (s->num_ops == cap) {                                        \
+            s->ops = realloc(s->ops, (cap *= 2) * sizeof(*s->ops));     \
+            origin = realloc(origin, cap * sizeof(int));                \
+        }                                                               \
+        origin[s->num_ops] = (from);                                    \
+        s->ops[s->num_ops++] = (mm_traceop_t){ (type_), (id_), (size_) }; \
+    } while (0)
+
+    for (i = 0, w = 0; w < nw; w++) {
+        lo = (long)w * t->num_ops / nw;
+        hi = (long)(w + 1) * t->num_ops / nw;
+        start = lo;
+        if (peak_op >= lo && peak_op < hi)
+            start = peak_op - len / 2;
+        if (start > hi - len)
+            start = hi - len;
+        if (start < lo)
+            start = lo;
+
+        /* Replay up to the window only to know the live sizes */
+        for (; i < start; i++)
+            if ((id = t->ops[i].index) >= 0)
+                sizes[id] = t->ops[i].type == 'f' ? 0 : t->ops[i].size + 1;
+
+        for (id = 0; id < t->num_ids; id++)
+            if (sizes[id]) {
+                map[id] = nfree > 0 ? idfree[--nfree] : nids++;
+                EMIT('a', map[id], sizes[id] - 1, -1);
+            }
+        for (; i < start + len && i < hi; i++) {
+            op = t->ops[i];
+            if ((id = op.index) >= 0) {
+                sizes[id] = op.type == 'f' ? 0 : op.size + 1;
+                if (map[id] < 0)     /* see sample_blocks */
+                    map[id] = nfree > 0 && op.type == 'a' ? idfree[--nfree]
+                                                          : nids++;
+                op.index = map[id];
+                if (op.type == 'f') {
+                    idfree[nfree++] = map[id];
+                    map[id] = -1;
+                }
+            }
+            EMIT(op.type, op.index, op.size, i);
+        }
+        for (id = 0; id < t->num_ids; id++)
+            if (map[id] >= 0) {
+                EMIT('f', map[id], 0, -1);
+                idfree[nfree++] = map[id];
+                map[id] = -1;
+            }
+    }
+#undef EMIT
+
+    s->num_ids = nids;
+    free(sizes);
+    free(map);
+    free(idfree);
+    return s;
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+/*
+ * windows - how many windows of the sample: as many as fit four median
+ *     lifetimes each, within [1, MAX_WINDOWS]
+ */
+static int windows(const block_t *b, int nblocks, double p, int num_ops)
+{
+    int *life = malloc((nblocks + 1) * sizeof(int));
+    int i, n = 0, median, nw;
+
+    for (i = 0; i < nblocks; i++)
+        if (b[i].last < num_ops)
+            life[n++] = b[i].last - b[i].first;
+    qsort(life, n, sizeof(int), cmp_int);
+    median = n > 0 ? life[n / 2] : 1;
+    free(life);
+    nw = p * num_ops / (4.0 * (median > 0 ? median : 1));
+    return nw < 1 ? 1 : (nw > MAX_WINDOWS ? MAX_WINDOWS : nw);
+}
+
+/*
+ * histograms - log2 histograms of request sizes and block lifetimes (in
+ *     ops, divided by scale), normalized to sum to 1
+ */
+static void histograms(const mm_trace_t *t, double scale, double *size,
+                       double *life)
+{
+    int *opblock = malloc((t->num_ops + 1) * sizeof(int));
+    int i, n, nreq = 0;
+    block_t *b = scan(t, opblock, &n);
+
+    memset(size, 0, NBUCKETS * sizeof(double));
+    memset(life, 0, NBUCKETS * sizeof(double));
+    for (i = 0; i < t->num_ops; i++)
+        if (t->ops[i].type != 'f') {
+            size[log2_bucket(t->ops[i].size)]++;
+            nreq++;
+        }
+    for (i = 0; i < n; i++)
+        life[log2_bucket((b[i].last - b[i].first) / scale)]++;
+    for (i = 0; i < NBUCKETS; i++) {
+        size[i] /= nreq > 0 ? nreq : 1;
+        life[i] /= n > 0 ? n : 1;
+    }
+    free(opblock);
+    free(b);
+}
+
+static double tv_distance(const double *a, const double *b)
+{
+    double d = 0;
+    int i;
+
+    for (i = 0; i < NBUCKETS; i++)
+        d += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+    return d / 2;
+}
+
+/*
+ * live_bytes - live payload bytes after each op; returns the peak
+ */
+static long live_bytes(const mm_trace_t *t, long *live)
+{
+    int *sizes = calloc(t->num_ids + 1, sizeof(int));
+    long bytes = 0, peak = 1;
+    int i;
+    mm_traceop_t *op;
+
+    for (i = 0; i < t->num_ops; i++) {
+        op = &t->ops[i];
+        if (op->index >= 0) {
+            bytes -= sizes[op->index];
+            sizes[op->index] = op->type == 'f' ? 0 : op->size;
+            bytes += sizes[op->index];
+        }
+        if (bytes > peak)
+            peak = bytes;
+        live[i] = bytes;
+    }
+    free(sizes);
+    return peak;
+}
+
+/*
+ * utilization - peak live payload over heap size, as in the driver
+ */
+static double utilization(const mm_trace_t *t)
+{
+    char **blocks = calloc(t->num_ids + 1, sizeof(char *));
+    int *sizes = calloc(t->num_ids + 1, sizeof(int));
+    long live = 0, peak = 0;
+    int i, id;
+    mm_traceop_t *op;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+        return 0;
+    for (i = 0; i < t->num_ops; i++) {
+        op = &t->ops[i];
+        if ((id = op->index) < 0) {
+            mm_free(NULL);
+            continue;
+        }
+        if (op->type == 'f') {
+            mm_free(blocks[id]);
+            live -= sizes[id];
+            sizes[id] = 0;
+            continue;
+        }
+        blocks[id] = op->type == 'a' ? mm_malloc(op->size)
+                                     : mm_realloc(blocks[id], op->size);
+        if (blocks[id] == NULL && op->size != 0)
+            return 0;
+        live += op->size - sizes[id];
+        sizes[id] = op->size;
+        if (live > peak)
+            peak = live;
+    }
+    free(blocks);
+    free(sizes);
+    return (double)peak / mem_heapsize();
+}
+
+static double util_with(const char *config, const mm_trace_t *t)
+{
+    char var[64], *eq;
+    double u;
+
+    snprintf(var, sizeof(var), "%s", config);
+    if ((eq = strchr(var, '=')) == NULL)
+        return utilization(t);
+    *eq = '\0';
+    setenv(var, eq + 1, 1);
+    u = utilization(t);
+    unsetenv(var);
+    return u;
+}
+
+static void report(const mm_trace_t *t, const mm_trace_t *s, double scale)
+{
+    double hs[2][NBUCKETS], hl[2][NBUCKETS], gap = 0, d;
+    double u0, u1, worst = 0;
+    long *l0 = malloc((t->num_ops + 1) * sizeof(long));
+    long *l1 = malloc((s->num_ops + 1) * sizeof(long));
+    long p0 = live_bytes(t, l0), p1 = live_bytes(s, l1);
+    int i;
+
+    histograms(t, 1, hs[0], hl[0]);
+    histograms(s, scale, hs[1], hl[1]);
+    for (i = 0; i < s->num_ops; i++) {
+        if (origin[i] < 0)
+            continue;
+        d = (double)l1[i] / p1 - (double)l0[origin[i]] / p0;
+        if ((d < 0 ? -d : d) > gap)
+            gap = d < 0 ? -d : d;
+    }
+    free(l0);
+    free(l1);
+
+    printf("ops %d -> %d (%.1f%%), ids %d -> %d\n", t->num_ops, s->num_ops,
+           100.0 * s->num_ops / (t->num_ops > 0 ? t->num_ops : 1),
+           t->num_ids, s->num_ids);
+    printf("size histogram distance     %.3f\n", tv_distance(hs[0], hs[1]));
+    printf("lifetime histogram distance %.3f\n", tv_distance(hl[0], hl[1]));
+    printf("live bytes gap              %.3f\n", gap);
+
+    mem_init();
+    printf("%-16s %8s %8s\n", "utilization", "full", "sample");
+    for (i = 0; i < NCONFIGS; i++) {
+        u0 = util_with(configs[i], t);
+        u1 = util_with(configs[i], s);
+        printf("%-16s %7.1f%% %7.1f%%\n",
+               configs[i][0] ? configs[i] : "default", 100 * u0, 100 * u1);
+        if ((d = u0 > u1 ? u0 - u1 : u1 - u0) > worst)
+            worst = d;
+    }
+    printf("fidelity: largest utilization difference %.1f points\n",
+           100 * worst);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: tracesample [-n <ops> | -p <fraction>] [-q] "
+            "<in.rep> <out.rep>\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    mm_trace_t *t, *s;
+    block_t *b;
+    int *opblock, nblocks, c, quiet = 0, target = DEFAULT_OPS, peak_op = 0;
+    double p = 0, scale = 1;
+    FILE *fp;
+
+    while ((c = getopt(argc, argv, "n:p:q")) != -1) {
+        switch (c) {
+        case 'n':
+            if ((target = atoi(optarg)) <= 0)
+                usage();
+            break;
+        case 'p':
+            if ((p = atof(optarg)) <= 0 || p > 1)
+                usage();
+            break;
+        case 'q':
+            quiet = 1;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc - 2)
+        usage();
+    if ((t = mm_trace_read(argv[optind])) == NULL)
+        return 1;
+    if (p == 0)
+        p = t->num_ops > target ? (double)target / t->num_ops : 1;
+
+    opblock = malloc((t->num_ops + 1) * sizeof(int));
+    b = scan(t, opblock, &nblocks);
+    if (p == 1 || peak_live(t, &peak_op) * p >= MIN_LIVE) {
+        s = sample_blocks(t, b, nblocks, opblock, p);
+        scale = p;
+        if (!quiet)
+            printf("%d of %d blocks\n", (int)(nblocks * p + 0.5), nblocks);
+    } else {
+        int nw = windows(b, nblocks, p, t->num_ops);
+
+        s = sample_windows(t, p, nw, peak_op);
+        if (!quiet)
+            printf("%d windows of %d ops\n", nw, (int)(p * t->num_ops / nw));
+    }
+
+    if ((fp = fopen(argv[optind + 1], "w")) == NULL ||
+        mm_trace_write(s, fp) < 0 || fclose(fp) != 0) {
+        perror(argv[optind + 1]);
+        return 1;
+    }
+    if (!quiet)
+        report(t, s, scale);
+
+    free(opblock);
+    free(b);
+    free(origin);
+    mm_trace_free(s);
+    mm_trace_free(t);
+    return 0;
+}